@@ -26,6 +26,9 @@
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
 #endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
 
 #include "ne_alloc.h"
 #include "ne_utils.h"
@@ -271,6 +274,194 @@ void ne_207_destroy(ne_207_parser *p)
     ne_free(p);
 }
 
+#define DISCARD_ID "http://webdav.org/neon/hooks/207-discard"
+
+/* The session private for ne_207_set_discard. */
+struct discard {
+    ne_207_tally *tally;
+};
+
+static void free_discard(void *userdata)
+{
+    ne_free(userdata);
+}
+
+void ne_207_set_discard(ne_session *sess, ne_207_tally *tally)
+{
+    struct discard *d = ne_get_session_private(sess, DISCARD_ID);
+
+    if (d == NULL) {
+	if (tally == NULL)
+	    return;
+	d = ne_calloc(sizeof *d);
+	ne_set_session_private(sess, DISCARD_ID, d);
+	ne_hook_destroy_session(sess, free_discard, d);
+    }
+    d->tally = tally;
+}
+
+ne_207_tally *ne_207_get_discard(ne_session *sess)
+{
+    struct discard *d = ne_get_session_private(sess, DISCARD_ID);
+    return d ? d->tally : NULL;
+}
+
+/* The scanner keeps just enough state between blocks to follow the
+ * tags: the local name of the one being read, truncated, and the
+ * start of the text of a status element. */
+struct ne_207_scanner_s {
+    ne_207_tally *tally;
+    enum {
+	SCAN_TEXT, /* in character data */
+	SCAN_OPEN, /* after a '<' */
+	SCAN_NAME, /* in a tag name */
+	SCAN_ATTRS, /* in a tag after its name */
+	SCAN_QUOTE, /* in an attribute value */
+	SCAN_SKIP, /* in a declaration, comment or PI */
+	SCAN_STATUS /* in the text of a status element */
+    } state;
+    char quote;
+    unsigned int closing:1, empty:1, valid:1;
+    int depth, elements;
+    char name[16], status[32];
+    size_t namelen, statlen;
+};
+
+ne_207_scanner *ne_207_scanner_create(ne_207_tally *tally)
+{
+    ne_207_scanner *s = ne_calloc(sizeof *s);
+    s->tally = tally;
+    s->valid = 1;
+    return s;
+}
+
+#define IS_NAME(s, n) ((s)->namelen == sizeof(n) - 1 && \
+		       memcmp((s)->name, n, sizeof(n) - 1) == 0)
+
+/* Counts the status line collected, "HTTP/1.1 200 OK": a code which
+ * is not 2xx is a failure. */
+static void scan_status(ne_207_scanner *s)
+{
+    size_t n = 0;
+
+    while (n < s->statlen && s->status[n] != ' ') n++;
+    while (n < s->statlen && s->status[n] == ' ') n++;
+    if (n == s->statlen || s->status[n] < '1' || s->status[n] > '5')
+	s->valid = 0;
+    else if (s->status[n] != '2')
+	s->tally->failures++;
+}
+
+/* Called at the '>' ending a tag. */
+static void scan_tag(ne_207_scanner *s)
+{
+    s->state = SCAN_TEXT;
+    if (s->closing) {
+	if (--s->depth < 0)
+	    s->valid = 0;
+	return;
+    }
+    s->elements++;
+    if (IS_NAME(s, "response"))
+	s->tally->responses++;
+    if (!s->empty) {
+	s->depth++;
+	if (IS_NAME(s, "status")) {
+	    s->state = SCAN_STATUS;
+	    s->statlen = 0;
+	}
+    }
+}
+
+void ne_207_scan(void *scanner, const char *block, size_t len)
+{
+    ne_207_scanner *s = scanner;
+    size_t n;
+
+    s->tally->bytes += len;
+
+    for (n = 0; n < len && s->valid; n++) {
+	char ch = block[n];
+
+	switch (s->state) {
+	case SCAN_TEXT:
+	    if (ch == '<')
+		s->state = SCAN_OPEN;
+	    break;
+	case SCAN_STATUS:
+	    if (ch == '<') {
+		scan_status(s);
+		s->state = SCAN_OPEN;
+	    } else if (s->statlen < sizeof s->status
+		       && (s->statlen > 0 || (ch != ' ' && ch != '\t' &&
+					      ch != '\r' && ch != '\n'))) {
+		s->status[s->statlen++] = ch;
+	    }
+	    break;
+	case SCAN_OPEN:
+	    s->closing = s->empty = 0;
+	    s->namelen = 0;
+	    if (ch == '/') {
+		s->closing = 1;
+		s->state = SCAN_NAME;
+		break;
+	    } else if (ch == '?' || ch == '!') {
+		s->state = SCAN_SKIP;
+		break;
+	    }
+	    s->state = SCAN_NAME;
+	    /* fall through */
+	case SCAN_NAME:
+	    if (ch == '>') {
+		scan_tag(s);
+	    } else if (ch == '/') {
+		s->empty = 1;
+		s->state = SCAN_ATTRS;
+	    } else if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n') {
+		s->state = SCAN_ATTRS;
+	    } else if (ch == ':') {
+		/* only the local name counts. */
+		s->namelen = 0;
+	    } else if (s->namelen < sizeof s->name) {
+		s->name[s->namelen++] = ch;
+	    } else {
+		/* too long to be one of ours. */
+		s->namelen = sizeof s->name;
+	    }
+	    break;
+	case SCAN_ATTRS:
+	    if (ch == '>') {
+		scan_tag(s);
+	    } else if (ch == '/') {
+		s->empty = 1;
+	    } else if (ch == '"' || ch == '\'') {
+		s->quote = ch;
+		s->state = SCAN_QUOTE;
+	    }
+	    break;
+	case SCAN_QUOTE:
+	    if (ch == s->quote)
+		s->state = SCAN_ATTRS;
+	    break;
+	case SCAN_SKIP:
+	    if (ch == '>')
+		s->state = SCAN_TEXT;
+	    break;
+	}
+    }
+}
+
+int ne_207_scanner_valid(const ne_207_scanner *s)
+{
+    return s->valid && s->depth == 0 && s->elements > 0 
+	&& s->state == SCAN_TEXT;
+}
+
+void ne_207_scanner_destroy(ne_207_scanner *s)
+{
+    ne_free(s);
+}
+
 int ne_accept_207(void *userdata, ne_request *req, const ne_status *status)
 {
     return (status->code == 207);
@@ -87,6 +87,41 @@ void *ne_207_get_current_response(ne_207_parser *p);
  * response is ignored gracefully.  */
 void ne_207_ignore_unknown(ne_207_parser *p);
 
+/* Counts kept of the 207 bodies which are drained rather than
+ * parsed: see ne_207_set_discard. */
+typedef struct {
+    off_t bytes; /* body bytes read */
+    int bodies; /* 207 bodies drained */
+    int responses; /* response elements found in them */
+    int failures; /* status elements giving a non-2xx code */
+} ne_207_tally;
+
+/* If 'tally' is non-NULL, the 207 bodies of PROPFIND responses read
+ * using 'sess' are no longer parsed as XML: they are only drained,
+ * with a cheap scan that the elements nest and of the status codes,
+ * and counted in 'tally'.  The results callbacks are not called.
+ * Pass NULL to have them parsed again; this may be switched between
+ * any two requests. */
+void ne_207_set_discard(ne_session *sess, ne_207_tally *tally);
+
+/* Returns the tally set by ne_207_set_discard, or NULL. */
+ne_207_tally *ne_207_get_discard(ne_session *sess);
+
+/* A scanner for draining a 207 body as above. */
+typedef struct ne_207_scanner_s ne_207_scanner;
+
+ne_207_scanner *ne_207_scanner_create(ne_207_tally *tally);
+
+/* Scan the given block of the body; may be passed to
+ * ne_add_response_body_reader with the scanner as userdata. */
+void ne_207_scan(void *scanner, const char *block, size_t len);
+
+/* Returns non-zero if the body scanned was complete and its elements
+ * nested properly. */
+int ne_207_scanner_valid(const ne_207_scanner *s);
+
+void ne_207_scanner_destroy(ne_207_scanner *s);
+
 /* Dispatch a DAV request and handle a 207 error response appropriately */
 int ne_simple_request(ne_session *sess, ne_request *req);
 
@@ -206,3 +206,92 @@ void ne_free_ml(void *ptr)
 }
 
 #endif /* NEON_MEMLEAK */
+
+/* Alignment of the memory returned by the pools. */
+union pool_align {
+    double d;
+    void *p;
+    long l;
+};
+#define POOL_ALIGN (sizeof(union pool_align))
+#define POOL_ROUND(n) (((n) + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1))
+
+/* Each block carries this header, rounded up to POOL_ALIGN, and the
+ * memory handed out follows it. */
+struct pool_block {
+    struct pool_block *next;
+};
+#define BLOCK_HEADER POOL_ROUND(sizeof(struct pool_block))
+
+struct ne_pool_s {
+    struct pool_block *extra; /* blocks allocated after the first */
+    char *pnt; /* next free byte of the current block */
+    size_t left; /* bytes left in the current block */
+    size_t blocksize;
+};
+#define POOL_HEADER POOL_ROUND(sizeof(struct ne_pool_s))
+
+ne_pool *ne_pool_create(size_t blocksize)
+{
+    ne_pool *pool;
+
+    blocksize = POOL_ROUND(blocksize);
+    pool = ne_malloc(POOL_HEADER + blocksize);
+    pool->extra = NULL;
+    pool->blocksize = blocksize;
+    ne_pool_clear(pool);
+    return pool;
+}
+
+void *ne_pool_alloc(ne_pool *pool, size_t size)
+{
+    char *ret;
+
+    size = POOL_ROUND(size);
+    if (size > pool->left) {
+	/* anything bigger than half a block gets a block to itself,
+	 * rather than wasting the rest of the current one. */
+	size_t len = size > pool->blocksize / 2 ? size : pool->blocksize;
+	struct pool_block *blk = ne_malloc(BLOCK_HEADER + len);
+
+	blk->next = pool->extra;
+	pool->extra = blk;
+	if (len == size)
+	    return (char *)blk + BLOCK_HEADER;
+	pool->pnt = (char *)blk + BLOCK_HEADER;
+	pool->left = len;
+    }
+    ret = pool->pnt;
+    pool->pnt += size;
+    pool->left -= size;
+    return ret;
+}
+
+void *ne_pool_calloc(ne_pool *pool, size_t size)
+{
+    return memset(ne_pool_alloc(pool, size), 0, size);
+}
+
+char *ne_pool_strdup(ne_pool *pool, const char *s)
+{
+    size_t len = strlen(s) + 1;
+    return memcpy(ne_pool_alloc(pool, len), s, len);
+}
+
+void ne_pool_clear(ne_pool *pool)
+{
+    struct pool_block *blk;
+
+    while ((blk = pool->extra) != NULL) {
+	pool->extra = blk->next;
+	ne_free(blk);
+    }
+    pool->pnt = (char *)pool + POOL_HEADER;
+    pool->left = pool->blocksize;
+}
+
+void ne_pool_destroy(ne_pool *pool)
+{
+    ne_pool_clear(pool);
+    ne_free(pool);
+}
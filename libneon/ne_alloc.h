@@ -53,6 +53,30 @@ char *ne_strndup(const char *s, size_t n);
  * afterwards. */
 #define NE_FREE(x) do { if ((x) != NULL) ne_free((x)); (x) = NULL; } while (0)
 
+/* A pool allocates memory in blocks, and only gives it all back at
+ * once, when cleared or destroyed: for objects which live and die
+ * together. */
+typedef struct ne_pool_s ne_pool;
+
+/* Create a pool which allocates in blocks of 'blocksize' bytes; the
+ * first is allocated along with the pool. */
+ne_pool *ne_pool_create(size_t blocksize);
+
+/* Returns 'size' bytes from the pool, uninitialized, or zeroed for
+ * the _calloc variant.  Never returns NULL. */
+void *ne_pool_alloc(ne_pool *pool, size_t size);
+void *ne_pool_calloc(ne_pool *pool, size_t size);
+
+/* Returns a copy of 's' allocated from the pool. */
+char *ne_pool_strdup(ne_pool *pool, const char *s);
+
+/* Give back everything allocated from the pool, keeping the first
+ * block for reuse. */
+void ne_pool_clear(ne_pool *pool);
+
+/* Destroy the pool, and everything allocated from it. */
+void ne_pool_destroy(ne_pool *pool);
+
 END_NEON_DECLS
 
 #endif /* NE_ALLOC_H */
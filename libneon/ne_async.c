@@ -0,0 +1,367 @@
+/*
+   Asynchronous request dispatch
+   Copyright (C) 2003, Teng Xu, GRASE Research Group at UCSC
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+   MA 02111-1307, USA
+
+*/
+
+#include "config.h"
+
+#include <sys/types.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+#include "ne_alloc.h"
+#include "ne_i18n.h"
+#include "ne_async.h"
+#include "ne_private.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+
+/* maximum number of events taken from each epoll_wait call. */
+#define MAX_EVENTS 64
+
+/* A request in progress. */
+struct async_req {
+    ne_request *req;
+    ne_session *sess;
+    enum ne_resp_part part; /* the part of the response awaited */
+    unsigned int resent:1; /* resent after a persistent connection
+			    * timeout. */
+    unsigned int watching:1; /* the connection is registered with epoll,
+			      * or on the ring */
+    struct ne_conn *conn; /* the connection registered... */
+    unsigned int serial; /* ...and its serial number at the time */
+    ne_async_done done;
+    void *userdata;
+    struct async_req *next, *prev;
+};
+
+struct ne_async_s {
+    int epfd;
+    ne_sock_ring *ring; /* the ring, used instead of epoll, or NULL */
+    int count;
+    struct async_req *reqs;
+    char buf[BUFSIZ]; /* scratch space for response body blocks */
+};
+
+/* Returns non-zero if the connection registered for 'ar' is still
+ * open.  If it has since been closed, its registration went with it,
+ * and the fd may already belong to somebody else. */
+static int still_watching(struct async_req *ar)
+{
+    return ar->watching && ar->conn->connected
+	&& ar->conn->serial == ar->serial;
+}
+
+static void unwatch(ne_async *as, struct async_req *ar)
+{
+    if (still_watching(ar)) {
+	if (as->ring)
+	    ne_sock_use_ring(ar->conn->socket, as->ring, NULL);
+	else
+	    epoll_ctl(as->epfd, EPOLL_CTL_DEL, 
+		      ne_sock_fd(ar->conn->socket), NULL);
+    }
+    ar->watching = 0;
+}
+
+static int watch(ne_async *as, struct async_req *ar)
+{
+    struct ne_conn *conn = ne_request_conn(ar->req);
+    struct epoll_event ev = {0};
+
+    if (still_watching(ar) && ar->conn == conn)
+	return 0;
+    unwatch(as, ar);
+
+    if (as->ring) {
+	/* the connection stays on the ring from now on; only who is
+	 * told of its data changes. */
+	if (ne_sock_use_ring(conn->socket, as->ring, ar)) {
+	    ne_set_error(ar->sess, _("Could not watch connection: %s"),
+			 ne_sock_error(conn->socket));
+	    return NE_ERROR;
+	}
+    } else {
+	ev.events = EPOLLIN;
+	ev.data.ptr = ar;
+	if (epoll_ctl(as->epfd, EPOLL_CTL_ADD,
+		      ne_sock_fd(conn->socket), &ev) < 0) {
+	    ne_set_error(ar->sess, _("Could not watch connection: %s"),
+			 strerror(errno));
+	    return NE_ERROR;
+	}
+    }
+    ar->conn = conn;
+    ar->serial = conn->serial;
+    ar->watching = 1;
+    return 0;
+}
+
+/* (Re-)send the request, and start waiting for the response. */
+static int send_request(ne_async *as, struct async_req *ar)
+{
+    int ret;
+
+    ret = ne_begin_send(ar->req);
+    if (ret == NE_RETRY && !ar->sess->no_persist) {
+	NE_DEBUG(NE_DBG_HTTP, "Persistent connection timed out, retrying.\n");
+	ret = ne_begin_send(ar->req);
+    }
+    if (ret == NE_OK) {
+	ar->part = ne_resp_head;
+	ret = watch(as, ar);
+    }
+    return ret;
+}
+
+static void complete(ne_async *as, struct async_req *ar, int ret)
+{
+    unwatch(as, ar);
+
+    if (ar->prev)
+	ar->prev->next = ar->next;
+    else
+	as->reqs = ar->next;
+    if (ar->next)
+	ar->next->prev = ar->prev;
+    as->count--;
+
+    NE_DEBUG(NE_DBG_HTTP, "Async request ends, status %d.\n", ret);
+    ar->done(ar->userdata, ar->req, ret);
+    ne_free(ar);
+}
+
+/* Take the response of 'ar' as far as the data which has arrived
+ * allows. */
+static void process(ne_async *as, struct async_req *ar)
+{
+    ssize_t ret;
+
+    for (;;) {
+	if (!ne_response_ready(ar->req, ar->part)) {
+	    ret = ne_sock_fill(ar->conn->socket);
+	    if (ret == 0)
+		return; /* wait for more */
+	    else if (ret > 0)
+		continue;
+	    /* else, let the next step run into the error. */
+	}
+
+	switch (ar->part) {
+	case ne_resp_head:
+	    ret = ne_begin_response(ar->req);
+	    if (ret == NE_RETRY && !ar->resent && !ar->sess->no_persist) {
+		NE_DEBUG(NE_DBG_HTTP, "Persistent connection timed out, "
+			 "retrying.\n");
+		ar->resent = 1;
+		ret = send_request(as, ar);
+		if (ret != NE_OK)
+		    complete(as, ar, ret);
+		return;
+	    } else if (ret != NE_OK) {
+		complete(as, ar, ret);
+		return;
+	    }
+	    ar->part = ne_resp_body;
+	    break;
+	case ne_resp_body:
+	    ret = ne_read_response_block(ar->req, as->buf, sizeof as->buf);
+	    if (ret < 0) {
+		complete(as, ar, NE_ERROR);
+		return;
+	    } else if (ret == 0) {
+		ar->part = ne_resp_trailer;
+	    }
+	    break;
+	case ne_resp_trailer:
+	    ret = ne_end_request(ar->req);
+	    if (ret == NE_RETRY) {
+		/* e.g. authentication is needed: go round again. */
+		ar->resent = 0;
+		ret = send_request(as, ar);
+		if (ret == NE_OK)
+		    return;
+	    }
+	    complete(as, ar, ret);
+	    return;
+	}
+    }
+}
+
+/* Called by the ring for each connection with data arrived. */
+static void ring_ready(void *userdata, void *sockdata)
+{
+    process(userdata, sockdata);
+}
+
+ne_async *ne_async_create(void)
+{
+    ne_async *as = ne_calloc(sizeof *as);
+
+    as->epfd = epoll_create(MAX_EVENTS);
+    if (as->epfd < 0) {
+	ne_free(as);
+	return NULL;
+    }
+    return as;
+}
+
+ne_async *ne_async_create_ring(unsigned int entries)
+{
+    ne_sock_ring *ring = ne_sock_ring_create(entries);
+    ne_async *as;
+
+    if (ring == NULL)
+	return NULL;
+    as = ne_calloc(sizeof *as);
+    as->epfd = -1;
+    as->ring = ring;
+    return as;
+}
+
+int ne_async_dispatch(ne_async *as, ne_request *req,
+		      ne_async_done done, void *userdata)
+{
+    ne_session *sess = ne_get_session(req);
+    struct async_req *ar;
+    int ret;
+
+    if (sess->use_ssl) {
+	ne_set_error(sess, _("Asynchronous requests not supported over SSL"));
+	return NE_ERROR;
+    }
+
+    ar = ne_calloc(sizeof *ar);
+    ar->req = req;
+    ar->sess = sess;
+    ar->done = done;
+    ar->userdata = userdata;
+
+    ret = send_request(as, ar);
+    if (ret != NE_OK) {
+	unwatch(as, ar);
+	ne_free(ar);
+	return ret;
+    }
+
+    ar->next = as->reqs;
+    if (as->reqs)
+	as->reqs->prev = ar;
+    as->reqs = ar;
+    as->count++;
+
+    return NE_OK;
+}
+
+int ne_async_run(ne_async *as, int msec)
+{
+    struct epoll_event evs[MAX_EVENTS];
+    int n, count;
+
+    if (as->count == 0)
+	return 0;
+
+    if (as->ring) {
+	/* the entries done with are off the ring by the time it
+	 * would call for them. */
+	if (ne_sock_ring_run(as->ring, msec, ring_ready, as) < 0)
+	    return errno == EINTR ? as->count : -1;
+	return as->count;
+    }
+
+    count = epoll_wait(as->epfd, evs, MAX_EVENTS, msec);
+    if (count < 0)
+	return errno == EINTR ? as->count : -1;
+
+    /* An entry is registered on one fd only, so it will not be seen
+     * again in this batch once process() has freed it. */
+    for (n = 0; n < count; n++)
+	process(as, evs[n].data.ptr);
+
+    return as->count;
+}
+
+int ne_async_pending(const ne_async *as)
+{
+    return as->count;
+}
+
+void ne_async_destroy(ne_async *as)
+{
+    struct async_req *ar, *next;
+
+    for (ar = as->reqs; ar != NULL; ar = next) {
+	next = ar->next;
+	unwatch(as, ar);
+	ne_free(ar);
+    }
+    if (as->ring)
+	ne_sock_ring_destroy(as->ring);
+    else
+	close(as->epfd);
+    ne_free(as);
+}
+
+#else /* !HAVE_SYS_EPOLL_H */
+
+ne_async *ne_async_create(void)
+{
+    return NULL;
+}
+
+ne_async *ne_async_create_ring(unsigned int entries)
+{
+    return NULL;
+}
+
+int ne_async_dispatch(ne_async *as, ne_request *req,
+		      ne_async_done done, void *userdata)
+{
+    return NE_ERROR;
+}
+
+int ne_async_run(ne_async *as, int msec)
+{
+    return -1;
+}
+
+int ne_async_pending(const ne_async *as)
+{
+    return 0;
+}
+
+void ne_async_destroy(ne_async *as)
+{
+}
+
+#endif /* HAVE_SYS_EPOLL_H */
@@ -0,0 +1,75 @@
+/*
+   Asynchronous request dispatch
+   Copyright (C) 2003, Teng Xu, GRASE Research Group at UCSC
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+   MA 02111-1307, USA
+
+*/
+
+#ifndef NE_ASYNC_H
+#define NE_ASYNC_H
+
+#include "ne_request.h"
+
+BEGIN_NEON_DECLS
+
+/* An ne_async drives many requests at once from a single thread: each
+ * request is sent straight away, and its response is then read
+ * piecemeal as it arrives, through the same header handlers and body
+ * readers as ne_request_dispatch would use.  Requests may share a
+ * session, each taking a connection of its own from the session's
+ * pool: see ne_set_max_connections.  Not supported for SSL
+ * sessions. */
+typedef struct ne_async_s ne_async;
+
+/* Called once the request 'req' has completed; 'result' is the NE_*
+ * code ne_request_dispatch would have returned.  The callback may
+ * destroy the request, or dispatch another one. */
+typedef void (*ne_async_done)(void *userdata, ne_request *req, int result);
+
+/* Returns a new dispatcher, or NULL if not supported on this
+ * platform. */
+ne_async *ne_async_create(void);
+
+/* As ne_async_create, but the connections are driven through an
+ * io_uring (see ne_sock_ring_create) of 'entries' entries rather than
+ * epoll: the requests sent between calls to ne_async_run are
+ * submitted together, and their responses arrive without a read call
+ * each.  Returns NULL if the kernel does not support it. */
+ne_async *ne_async_create_ring(unsigned int entries);
+
+/* Sends the request 'req', which may block whilst connecting or
+ * writing.  'done' will be called from ne_async_run once the response
+ * has been read.  Returns NE_OK, or an NE_* code if the request could
+ * not be sent, in which case 'done' is never called. */
+int ne_async_dispatch(ne_async *as, ne_request *req,
+		      ne_async_done done, void *userdata);
+
+/* Waits for up to 'msec' milliseconds (or indefinitely if 'msec' is
+ * negative) for responses to arrive, and processes them.  Returns the
+ * number of requests still outstanding, or -1 on error. */
+int ne_async_run(ne_async *as, int msec);
+
+/* Returns the number of requests outstanding. */
+int ne_async_pending(const ne_async *as);
+
+/* Destroys the dispatcher; any requests still outstanding are left
+ * unfinished, and their callbacks never called. */
+void ne_async_destroy(ne_async *as);
+
+END_NEON_DECLS
+
+#endif /* NE_ASYNC_H */
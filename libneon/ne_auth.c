@@ -871,7 +871,7 @@ static void ah_create(ne_request *req, void *session, const char *method,
 		      const char *uri)
 {
     auth_session *sess = session;
-    struct auth_request *areq = ne_calloc(sizeof *areq);
+    struct auth_request *areq = ne_request_alloc(req, sizeof *areq);
 
     NE_DEBUG(NE_DBG_HTTPAUTH, "ah_create, for %s\n", sess->spec->resp_hdr);
 
@@ -969,13 +969,6 @@ static int ah_post_send(ne_request *req, void *cookie, const ne_status *status)
     return ret;
 }
 
-static void ah_destroy(ne_request *req, void *session)
-{
-    auth_session *sess = session;
-    struct auth_request *areq = ne_get_request_private(req, sess->spec->id);
-    ne_free(areq);
-}
-
 static void free_auth(void *cookie)
 {
     auth_session *sess = cookie;
@@ -999,7 +992,6 @@ static void auth_register(ne_session *sess,
     ne_hook_create_request(sess, ah_create, ahs);
     ne_hook_pre_send(sess, ah_pre_send, ahs);
     ne_hook_post_send(sess, ah_post_send, ahs);
-    ne_hook_destroy_request(sess, ah_destroy, ahs);
     ne_hook_destroy_session(sess, free_auth, ahs);
 
     ne_set_session_private(sess, id, ahs);
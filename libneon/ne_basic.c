@@ -341,6 +341,31 @@ int ne_get(ne_session *sess, const char *uri, int fd)
 }
 
 
+int ne_get_sink(ne_session *sess, const char *uri, int fd, off_t *length)
+{
+    ne_request *req = ne_request_create(sess, "GET", uri);
+    int ret;
+
+    do {
+	ret = ne_begin_request(req);
+	if (ret != NE_OK)
+	    break;
+	ret = ne_read_response_to_fd(req, ne_get_status(req)->klass == 2
+				     ? fd : -1);
+	if (ret != NE_OK)
+	    break;
+	ret = ne_end_request(req);
+    } while (ret == NE_RETRY);
+
+    if (ret == NE_OK && ne_get_status(req)->klass != 2)
+	ret = NE_ERROR;
+    if (length)
+	*length = ne_get_response_length(req);
+
+    ne_request_destroy(req);
+    return ret;
+}
+
 /* Get to given fd */
 int ne_post(ne_session *sess, const char *uri, int fd, const char *buffer)
 {
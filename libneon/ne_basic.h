@@ -32,6 +32,13 @@ BEGIN_NEON_DECLS
  * body which is returned to 'fd'. */
 int ne_get(ne_session *sess, const char *path, int fd);
 
+/* As ne_get, but the entity body goes straight to 'fd' with
+ * ne_read_response_to_fd, and the response body readers are skipped:
+ * if 'fd' is -1 it is read and thrown away.  A body which comes with
+ * an error status is always thrown away.  If 'length' is non-NULL,
+ * the number of body bytes read is stored there. */
+int ne_get_sink(ne_session *sess, const char *path, int fd, off_t *length);
+
 /* Perform a PUT request on resource at 'path', reading the entity
  * body to submit from 'fd'. */
 int ne_put(ne_session *sess, const char *path, int fd);
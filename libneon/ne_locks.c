@@ -123,9 +123,8 @@ static const ne_propname lock_props[] = {
 static void lk_create(ne_request *req, void *session, 
 		       const char *method, const char *uri)
 {
-    struct lh_req_cookie *lrc = ne_malloc(sizeof *lrc);
+    struct lh_req_cookie *lrc = ne_request_alloc(req, sizeof *lrc);
     lrc->store = session;
-    lrc->submit = NULL;
     ne_set_request_private(req, HOOK_ID, lrc);
 }
 
@@ -178,7 +177,6 @@ static void lk_destroy(ne_request *req, void *userdata)
 {
     struct lh_req_cookie *lrc = ne_get_request_private(req, HOOK_ID);
     free_list(lrc->submit, 0);
-    ne_free(lrc);
 }
 
 void ne_lockstore_destroy(ne_lock_store *store)
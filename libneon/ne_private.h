@@ -53,9 +53,10 @@ struct hook {
 #define HAVE_HOOK(st,func) (st->hook->hooks->func != NULL)
 #define HOOK_FUNC(st, func) (*st->hook->hooks->func)
 
-/* Session support. */
-struct ne_session_s {
-    /* Connection information */
+/* A connection to the server (or proxy).  A session keeps a pool of
+ * these; a request checks one out as it is sent, and checks it back
+ * in once the response has been read. */
+struct ne_conn {
     ne_socket *socket;
 
     /* non-zero if connection has been established. */
@@ -64,6 +65,30 @@ struct ne_session_s {
     /* non-zero if connection has persisted beyond one request. */
     int persisted;
 
+    /* bumped for every new connection; lets an event loop tell whether
+     * the connection it is watching is still the same one. */
+    unsigned int serial;
+
+    ne_hrtime last_used; /* when last checked in */
+    unsigned int in_use:1; /* checked out by a request */
+
+    struct ne_conn *next;
+};
+
+/* Session support. */
+struct ne_session_s {
+    /* Connection pool: 'nconns' connections, of at most 'max_conns'. */
+    struct ne_conn *conns;
+    int nconns, max_conns;
+
+    /* destroyed requests kept to be reused by ne_request_create. */
+    struct ne_request_s *spare_reqs;
+    int nspare_reqs;
+
+    /* idle connections are not reused after this long [s]; zero for
+     * no limit. */
+    int idle_timeout;
+
     int is_http11; /* >0 if connected server is known to be
 		    * HTTP/1.1 compliant. */
 
@@ -75,6 +100,9 @@ struct ne_session_s {
     unsigned int no_persist:1; /* set to disable persistent connections */
     unsigned int use_ssl:1; /* whether a secure connection is required */
     unsigned int in_connect:1; /* doing a proxy CONNECT */
+    unsigned int nagle:1; /* leave TCP_NODELAY off on connections */
+    unsigned int cork:1; /* cork connections while writing requests */
+    unsigned int race:1; /* connect to all the addresses at once */
 
     int expect100_works; /* known state of 100-continue support */
 
@@ -84,7 +112,14 @@ struct ne_session_s {
     ne_notify_status notify_cb;
     void *notify_ud;
 
-    int rdtimeout; /* read timeout. */
+    int rdtimeout; /* read timeout [ms], or 0 for the default. */
+    int cotimeout; /* connect timeout [ms], or 0 for none. */
+    size_t rdbufmax; /* most the read buffer may grow to, or 0 */
+    int addr_flags; /* NE_ADDR_* flags for resolving hostnames */
+
+    /* timing of the last request ended on this session. */
+    ne_request_timing last_timing;
+    ne_sock_stats last_syscalls;
 
     struct hook *create_req_hooks, *pre_send_hooks, *post_send_hooks;
     struct hook *destroy_req_hooks, *destroy_sess_hooks, *private;
@@ -124,4 +159,34 @@ int ne_pull_request_body(ne_request *req, ne_push_fn fn, void *ud);
 /* Do the SSL negotiation. */
 int ne_negotiate_ssl(ne_request *req);
 
+/* Returns the connection checked out by 'req', or NULL if it has
+ * none. */
+struct ne_conn *ne_request_conn(const ne_request *req);
+
+/* Close the connection 'conn', which stays in the pool to be opened
+ * again. */
+void ne_close_conn(struct ne_conn *conn);
+
+/* Free the spare requests kept by the session. */
+void ne_free_spare_requests(ne_session *sess);
+
+/* The steps of ne_begin_request, for the asynchronous interface
+ * (ne_async.c).  ne_begin_send sends the request and its body, and
+ * returns without reading any of the response.  ne_begin_response
+ * then reads the Status-Line and headers of the response; both return
+ * NE_* codes as ne_begin_request. */
+int ne_begin_send(ne_request *req);
+int ne_begin_response(ne_request *req);
+
+enum ne_resp_part {
+    ne_resp_head, /* ne_begin_response */
+    ne_resp_body, /* ne_read_response_block */
+    ne_resp_trailer /* ne_end_request */
+};
+
+/* Returns non-zero if the step reading the given 'part' of the
+ * response can be taken without waiting on the network, using only
+ * the data already buffered on the socket. */
+int ne_response_ready(ne_request *req, enum ne_resp_part part);
+
 #endif /* HTTP_PRIVATE_H */
@@ -33,29 +33,7 @@
 #include "ne_props.h"
 #include "ne_basic.h"
 #include "ne_locks.h"
-
-struct ne_propfind_handler_s {
-    ne_session *sess;
-    ne_request *request;
-
-    int has_props; /* whether we've already written some
-		    * props to the body. */
-    ne_buffer *body;
-    
-    ne_207_parser *parser207;
-    ne_xml_parser *parser;
-
-    /* Callback to manage the private structure. */
-    ne_props_alloc_complex private_alloc;
-    ne_props_free_complex private_free;
-    void *private_userdata;
-    
-    /* Current propset, or NULL if none being processed. */
-    ne_prop_result_set *current;
-
-    ne_props_result callback;
-    void *userdata;
-};
+#include "ne_i18n.h"
 
 #define ELM_namedprop (NE_ELM_207_UNUSED)
 
@@ -64,9 +42,11 @@ static const struct ne_xml_elm flat_elms[] = {
     { NULL }
 };
 
-/* We build up the results of one 'response' element in memory. */
+/* We build up the results of one 'response' element in memory.  The
+ * nspace is interned by the XML parser; the other strings come from
+ * the handler's pool. */
 struct prop {
-    char *name, *nspace, *value, *lang;
+    const char *name, *nspace, *value, *lang;
     /* Store a ne_propname here too, for convienience.  pname.name =
      * name, pname.nspace = nspace, but they are const'ed in pname. */
     ne_propname pname;
@@ -76,16 +56,60 @@ struct prop {
 
 struct propstat {
     struct prop *props;
-    int numprops;
+    int numprops, maxprops;
     ne_status status;
 };
 
-/* Results set. */
+/* An entry in the hash index of a results set. */
+struct propref {
+    struct prop *prop;
+    struct propstat *pstat;
+    int next; /* the next in the same bucket, or -1 */
+};
+
+/* Results set.  The pstats and props arrays are kept from one
+ * response to the next, so only grow; so do the arrays of the hash
+ * index, which is built on the first lookup in a large set. */
 struct ne_prop_result_set_s {
     struct propstat *pstats;
-    int numpstats;
+    int numpstats, maxpstats;
     void *private;
     char *href;
+    struct propref *refs;
+    int *buckets;
+    int maxrefs, nbuckets;
+    unsigned int indexed:1;
+};
+
+/* Sets with fewer props than this are searched without an index. */
+#define INDEX_MIN (16)
+
+struct ne_propfind_handler_s {
+    ne_session *sess;
+    ne_request *request;
+
+    int has_props; /* whether we've already written some
+		    * props to the body. */
+    ne_buffer *body;
+    
+    ne_207_parser *parser207;
+    ne_xml_parser *parser;
+
+    /* Callback to manage the private structure. */
+    ne_props_alloc_complex private_alloc;
+    ne_props_free_complex private_free;
+    void *private_userdata;
+    
+    /* Current propset, or NULL if none being processed. */
+    ne_prop_result_set *current;
+
+    /* The propset is reused for each response in turn, its strings
+     * allocated from 'pool', which is cleared after each. */
+    ne_prop_result_set set;
+    ne_pool *pool;
+
+    ne_props_result callback;
+    void *userdata;
 };
 
 
@@ -106,9 +130,36 @@ ne_request *ne_propfind_get_request(ne_propfind_handler *handler)
     return handler->request;
 }
 
+/* Dispatch the PROPFIND of 'handler', draining the 207 body into
+ * 'tally' rather than parsing it. */
+static int discard(ne_propfind_handler *handler, ne_207_tally *tally)
+{
+    ne_request *req = handler->request;
+    ne_207_scanner *scan = ne_207_scanner_create(tally);
+    int ret;
+
+    ne_add_response_body_reader(req, ne_accept_207, ne_207_scan, scan);
+
+    ret = ne_request_dispatch(req);
+
+    if (ret == NE_OK && ne_get_status(req)->klass != 2) {
+	ret = NE_ERROR;
+    } else if (ret == NE_OK && ne_get_status(req)->code == 207) {
+	tally->bodies++;
+	if (!ne_207_scanner_valid(scan)) {
+	    ne_set_error(handler->sess, _("Malformed 207 response body"));
+	    ret = NE_ERROR;
+	}
+    }
+
+    ne_207_scanner_destroy(scan);
+    return ret;
+}
+
 static int propfind(ne_propfind_handler *handler, 
 		    ne_props_result results, void *userdata)
 {
+    ne_207_tally *tally;
     int ret;
     ne_request *req = handler->request;
 
@@ -124,11 +175,17 @@ static int propfind(ne_propfind_handler *handler,
     handler->callback = results;
     handler->userdata = userdata;
 
-    ne_set_request_body_buffer(req, handler->body->data,
-			       ne_buffer_size(handler->body));
-
-    ne_add_request_header(req, "Content-Type", NE_XML_MEDIA_TYPE);
+    /* a request from a template has its body already. */
+    if (handler->body) {
+	ne_set_request_body_buffer(req, handler->body->data,
+				   ne_buffer_size(handler->body));
+	ne_add_request_header(req, "Content-Type", NE_XML_MEDIA_TYPE);
+    }
     
+    tally = ne_207_get_discard(handler->sess);
+    if (tally)
+	return discard(handler, tally);
+
     ne_add_response_body_reader(req, ne_accept_207, ne_xml_parse_v, 
 				  handler->parser);
 
@@ -144,21 +201,29 @@ static int propfind(ne_propfind_handler *handler,
     return ret;
 }
 
-static void set_body(ne_propfind_handler *hdl, const ne_propname *names)
+/* The start of a PROPFIND request body is fixed: */
+#define PROPFIND_START "<?xml version=\"1.0\" encoding=\"utf-8\"?>" EOL \
+    "<propfind xmlns=\"DAV:\">"
+
+/* Append an element for each of 'names' to 'body'. */
+static void names_body(ne_buffer *body, const ne_propname *names)
 {
-    ne_buffer *body = hdl->body;
     int n;
-    
-    if (!hdl->has_props) {
-	ne_buffer_zappend(body, "<prop>" EOL);
-	hdl->has_props = 1;
-    }
 
     for (n = 0; names[n].name != NULL; n++) {
 	ne_buffer_concat(body, "<", names[n].name, " xmlns=\"", 
 			 NSPACE(names[n].nspace), "\"/>" EOL, NULL);
     }
+}
 
+static void set_body(ne_propfind_handler *hdl, const ne_propname *names)
+{
+    if (!hdl->has_props) {
+	ne_buffer_zappend(hdl->body, "<prop>" EOL);
+	hdl->has_props = 1;
+    }
+
+    names_body(hdl->body, names);
 }
 
 int ne_propfind_allprop(ne_propfind_handler *handler, 
@@ -178,41 +243,192 @@ int ne_propfind_named(ne_propfind_handler *handler, const ne_propname *props,
 
 
 /* The easy one... PROPPATCH */
+
+/* Write the PROPPATCH request body for 'items' to 'body'. */
+#define PROPPATCH_HEAD "<?xml version=\"1.0\" encoding=\"utf-8\" ?>" EOL \
+    "<D:propertyupdate xmlns:D=\"DAV:\">"
+#define PROPPATCH_TAIL "</D:propertyupdate>" EOL
+
+/* Append the markup which comes before the value of operation 'op',
+ * and that which comes after it, to 'open' and 'close'. */
+static void proppatch_markup(ne_buffer *open, ne_buffer *close,
+			     const ne_proppatch_operation *op)
+{
+    const char *elm = (op->type == ne_propset) ? "set" : "remove";
+
+    /* <set><prop><prop-name>value</prop-name></prop></set> */
+    ne_buffer_concat(open, "<D:", elm, "><D:prop>"
+		     "<", op->name->name, NULL);
+	
+    if (op->name->nspace) {
+	ne_buffer_concat(open, " xmlns=\"", op->name->nspace, "\"", NULL);
+    }
+    ne_buffer_append(open, ">", 1);
+
+    ne_buffer_concat(close, "</", op->name->name, "></D:prop></D:", elm, ">"
+		     EOL, NULL);
+}
+
+static void proppatch_body(ne_buffer *body, 
+			   const ne_proppatch_operation *items)
+{
+    ne_buffer *close = ne_buffer_create();
+    int n;
+
+    ne_buffer_zappend(body, PROPPATCH_HEAD);
+
+    for (n = 0; items[n].name != NULL; n++) {
+	ne_buffer_clear(close);
+	proppatch_markup(body, close, &items[n]);
+	if (items[n].type == ne_propset) {
+	    ne_buffer_zappend(body, items[n].value);
+	}
+	ne_buffer_append(body, close->data, ne_buffer_size(close));
+    }	
+
+    ne_buffer_zappend(body, PROPPATCH_TAIL);
+    ne_buffer_destroy(close);
+}
+
 int ne_proppatch(ne_session *sess, const char *uri, 
 		 const ne_proppatch_operation *items)
 {
     ne_request *req = ne_request_create(sess, "PROPPATCH", uri);
     ne_buffer *body = ne_buffer_create();
-    int n, ret;
+    int ret;
     
-    /* Create the request body */
-    ne_buffer_zappend(body, "<?xml version=\"1.0\" encoding=\"utf-8\" ?>" EOL
-		     "<D:propertyupdate xmlns:D=\"DAV:\">");
+    proppatch_body(body, items);
 
-    for (n = 0; items[n].name != NULL; n++) {
-	const char *elm = (items[n].type == ne_propset) ? "set" : "remove";
+    ne_set_request_body_buffer(req, body->data, ne_buffer_size(body));
+    ne_add_request_header(req, "Content-Type", NE_XML_MEDIA_TYPE);
+    
+#ifdef USE_DAV_LOCKS
+    ne_lock_using_resource(req, uri, NE_DEPTH_ZERO);
+#endif
 
-	/* <set><prop><prop-name>value</prop-name></prop></set> */
-	ne_buffer_concat(body, "<D:", elm, "><D:prop>"
-			 "<", items[n].name->name, NULL);
-	
-	if (items[n].name->nspace) {
-	    ne_buffer_concat(body, " xmlns=\"", items[n].name->nspace, "\"", NULL);
-	}
+    ret = ne_simple_request(sess, req);
+    
+    ne_buffer_destroy(body);
 
-	if (items[n].type == ne_propset) {
-	    ne_buffer_concat(body, ">", items[n].value, NULL);
-	} else {
-	    ne_buffer_append(body, ">", 1);
+    return ret;
+}
+
+/* State of a PROPPATCH body being generated by ne_proppatch_stream:
+ * the body is sent as a sequence of pieces, one at a time. */
+struct pp_stream {
+    ne_proppatch_iterator iter;
+    void *userdata;
+    ne_buffer *open, *close; /* markup either side of the value */
+    const char *value; /* value of the current operation, or NULL */
+    enum {
+	PP_START, PP_HEAD, PP_OPEN, PP_VALUE, PP_CLOSE, PP_TAIL, PP_DONE
+    } state; /* the piece being sent */
+    const char *pnt; /* what is left of the piece */
+    size_t left;
+};
+
+static void pp_restart(struct pp_stream *pp)
+{
+    pp->iter(pp->userdata, NULL);
+    pp->state = PP_START;
+    pp->left = 0;
+}
+
+/* Move 'pp' on to the next piece of the body; returns zero once there
+ * are no more. */
+static int pp_next(struct pp_stream *pp)
+{
+    ne_proppatch_operation op;
+
+    switch (pp->state) {
+    case PP_START:
+	pp->pnt = PROPPATCH_HEAD;
+	pp->state = PP_HEAD;
+	break;
+    case PP_HEAD:
+    case PP_CLOSE:
+	if (!pp->iter(pp->userdata, &op)) {
+	    pp->pnt = PROPPATCH_TAIL;
+	    pp->state = PP_TAIL;
+	    break;
+	}
+	ne_buffer_clear(pp->open);
+	ne_buffer_clear(pp->close);
+	proppatch_markup(pp->open, pp->close, &op);
+	pp->value = op.type == ne_propset ? op.value : NULL;
+	pp->pnt = pp->open->data;
+	pp->state = PP_OPEN;
+	break;
+    case PP_OPEN:
+	if (pp->value) {
+	    pp->pnt = pp->value;
+	    pp->state = PP_VALUE;
+	    break;
 	}
+	/* fall through */
+    case PP_VALUE:
+	pp->pnt = pp->close->data;
+	pp->state = PP_CLOSE;
+	break;
+    case PP_TAIL:
+	pp->state = PP_DONE;
+	/* fall through */
+    case PP_DONE:
+	return 0;
+    }
 
-	ne_buffer_concat(body, "</", items[n].name->name, "></D:prop></D:", elm, ">"
-			 EOL, NULL);
-    }	
+    pp->left = strlen(pp->pnt);
+    return 1;
+}
 
-    ne_buffer_zappend(body, "</D:propertyupdate>" EOL);
+static ssize_t pp_provide(void *userdata, char *buffer, size_t buflen)
+{
+    struct pp_stream *pp = userdata;
+    size_t len = 0;
 
-    ne_set_request_body_buffer(req, body->data, ne_buffer_size(body));
+    if (buflen == 0) {
+	pp_restart(pp);
+	return 0;
+    }
+
+    while (len < buflen) {
+	size_t n;
+
+	if (pp->left == 0 && !pp_next(pp))
+	    break;
+	n = pp->left < buflen - len ? pp->left : buflen - len;
+	memcpy(buffer + len, pp->pnt, n);
+	pp->pnt += n;
+	pp->left -= n;
+	len += n;
+    }
+
+    return len;
+}
+
+int ne_proppatch_stream(ne_session *sess, const char *uri,
+			ne_proppatch_iterator iter, void *userdata)
+{
+    ne_request *req = ne_request_create(sess, "PROPPATCH", uri);
+    struct pp_stream pp = {0};
+    int ret;
+
+    pp.iter = iter;
+    pp.userdata = userdata;
+    pp.open = ne_buffer_create();
+    pp.close = ne_buffer_create();
+
+    if (ne_version_pre_http11(sess)) {
+	/* no chunked encoding: go through it once for the length. */
+	size_t size = 0;
+
+	pp_restart(&pp);
+	while (pp_next(&pp))
+	    size += pp.left;
+	ne_set_request_body_provider(req, size, pp_provide, &pp);
+    } else {
+	ne_set_request_body_provider_chunked(req, pp_provide, &pp);
+    }
     ne_add_request_header(req, "Content-Type", NE_XML_MEDIA_TYPE);
     
 #ifdef USE_DAV_LOCKS
@@ -220,12 +436,36 @@ int ne_proppatch(ne_session *sess, const char *uri,
 #endif
 
     ret = ne_simple_request(sess, req);
-    
-    ne_buffer_destroy(body);
 
+    ne_buffer_destroy(pp.open);
+    ne_buffer_destroy(pp.close);
     return ret;
 }
 
+ne_request_template *ne_proppatch_template(ne_session *sess,
+					   const ne_proppatch_operation *items)
+{
+    ne_request_template *tpl = ne_template_create(sess, "PROPPATCH");
+    ne_buffer *body = ne_buffer_create();
+
+    proppatch_body(body, items);
+    ne_template_add_header(tpl, "Content-Type", NE_XML_MEDIA_TYPE);
+    ne_template_set_body(tpl, body->data, ne_buffer_size(body));
+    ne_buffer_destroy(body);
+    return tpl;
+}
+
+int ne_proppatch_tpl(ne_request_template *tpl, const char *uri)
+{
+    ne_request *req = ne_template_request(tpl, uri);
+
+#ifdef USE_DAV_LOCKS
+    ne_lock_using_resource(req, uri, NE_DEPTH_ZERO);
+#endif
+
+    return ne_simple_request(ne_get_session(req), req);
+}
+
 /* Compare two property names. */
 static int pnamecmp(const ne_propname *pn1, const ne_propname *pn2)
 {
@@ -241,6 +481,53 @@ static int pnamecmp(const ne_propname *pn1, const ne_propname *pn2)
     }
 }
 
+static unsigned int hash_pname(const ne_propname *pn)
+{
+    const char *pnt;
+    unsigned int hash = 5381;
+
+    for (pnt = NSPACE(pn->nspace); *pnt; pnt++)
+	hash = hash * 33 + (unsigned char)*pnt;
+    for (pnt = pn->name, hash *= 33; *pnt; pnt++)
+	hash = hash * 33 + (unsigned char)*pnt;
+    return hash;
+}
+
+/* Build the hash index of the 'total' props in 'set'. */
+static void index_props(ne_prop_result_set *set, int total)
+{
+    int ps, p, n, size;
+
+    for (size = 64; size < total * 2; size *= 2)
+	/* nullop */;
+    if (size > set->nbuckets) {
+	set->nbuckets = size;
+	set->buckets = ne_realloc(set->buckets, size * sizeof(int));
+    }
+    if (total > set->maxrefs) {
+	set->maxrefs = total;
+	set->refs = ne_realloc(set->refs, total * sizeof(struct propref));
+    }
+    memset(set->buckets, -1, set->nbuckets * sizeof(int));
+
+    /* In reverse, so the first of any props of the same name is found
+     * first, as by the linear search. */
+    n = total;
+    for (ps = set->numpstats - 1; ps >= 0; ps--) {
+	for (p = set->pstats[ps].numprops - 1; p >= 0; p--) {
+	    struct propref *ref = &set->refs[--n];
+	    unsigned int b;
+
+	    ref->prop = &set->pstats[ps].props[p];
+	    ref->pstat = &set->pstats[ps];
+	    b = hash_pname(&ref->prop->pname) & (set->nbuckets - 1);
+	    ref->next = set->buckets[b];
+	    set->buckets[b] = n;
+	}
+    }
+    set->indexed = 1;
+}
+
 /* Find property in 'set' with name 'pname'.  If found, set pstat_ret
  * to the containing propstat, likewise prop_ret, and returns zero.
  * If not found, returns non-zero.  */
@@ -248,7 +535,31 @@ static int findprop(const ne_prop_result_set *set, const ne_propname *pname,
 		    struct propstat **pstat_ret, struct prop **prop_ret)
 {
     
-    int ps, p;
+    int ps, p, total = 0;
+
+    for (ps = 0; !set->indexed && ps < set->numpstats; ps++)
+	total += set->pstats[ps].numprops;
+
+    if (set->indexed || total >= INDEX_MIN) {
+	int n;
+
+	/* the index is a cache: building it does not change the
+	 * results, so the set is still const to the caller. */
+	if (!set->indexed)
+	    index_props((ne_prop_result_set *)set, total);
+
+	n = set->buckets[hash_pname(pname) & (set->nbuckets - 1)];
+	for (; n != -1; n = set->refs[n].next) {
+	    if (pnamecmp(&set->refs[n].prop->pname, pname) == 0) {
+		if (pstat_ret != NULL)
+		    *pstat_ret = set->refs[n].pstat;
+		if (prop_ret != NULL)
+		    *prop_ret = set->refs[n].prop;
+		return 0;
+	    }
+	}
+	return -1;
+    }
 
     for (ps = 0; ps < set->numpstats; ps++) {
 	for (p = 0; p < set->pstats[ps].numprops; p++) {
@@ -348,10 +659,11 @@ static int check_context(void *ud, ne_xml_elmid parent, ne_xml_elmid child)
 
 static void *start_response(void *userdata, const char *href)
 {
-    ne_prop_result_set *set = ne_calloc(sizeof(*set));
     ne_propfind_handler *hdl = userdata;
+    ne_prop_result_set *set = &hdl->set;
 
-    set->href = ne_strdup(href);
+    set->href = ne_pool_strdup(hdl->pool, href);
+    set->private = NULL;
 
     if (hdl->private_alloc)
 	set->private = hdl->private_alloc(hdl->private_userdata, href);
@@ -368,11 +680,18 @@ static void *start_propstat(void *userdata, void *response)
     struct propstat *pstat;
 
     n = set->numpstats;
-    set->pstats = ne_realloc(set->pstats, sizeof(struct propstat) * (n+1));
+    if (n == set->maxpstats) {
+	set->maxpstats = n ? n * 2 : 4;
+	set->pstats = ne_realloc(set->pstats, 
+				 sizeof(struct propstat) * set->maxpstats);
+	memset(&set->pstats[n], 0, 
+	       sizeof(struct propstat) * (set->maxpstats - n));
+    }
     set->numpstats = n+1;
 
     pstat = &set->pstats[n];
-    memset(pstat, 0, sizeof(*pstat));
+    pstat->numprops = 0;
+    memset(&pstat->status, 0, sizeof pstat->status);
     
     /* And return this as the new pstat. */
     return &set->pstats[n];
@@ -397,17 +716,22 @@ startelm(void *userdata, const struct ne_xml_elm *elm,
     /* Add a property to this propstat */
     n = pstat->numprops;
 
-    pstat->props = ne_realloc(pstat->props, sizeof(struct prop) * (n + 1));
+    if (n == pstat->maxprops) {
+	pstat->maxprops = n ? n * 2 : 8;
+	pstat->props = ne_realloc(pstat->props, 
+				  sizeof(struct prop) * pstat->maxprops);
+    }
     pstat->numprops = n+1;
+    hdl->set.indexed = 0;
 
     /* Fill in the new property. */
     prop = &pstat->props[n];
 
-    prop->pname.name = prop->name = ne_strdup(elm->name);
+    prop->pname.name = prop->name = ne_pool_strdup(hdl->pool, elm->name);
     if (elm->nspace[0] == '\0') {
 	prop->pname.nspace = prop->nspace = NULL;
     } else {
-	prop->pname.nspace = prop->nspace = ne_strdup(elm->nspace);
+	prop->pname.nspace = prop->nspace = elm->nspace;
     }
     prop->value = NULL;
 
@@ -421,7 +745,7 @@ startelm(void *userdata, const struct ne_xml_elm *elm,
      * Also, I think we might need attribute namespace handling here.  */
     lang = ne_xml_get_attr(hdl->parser, atts, NULL, "xml:lang");
     if (lang != NULL) {
-	prop->lang = ne_strdup(lang);
+	prop->lang = ne_pool_strdup(hdl->pool, lang);
 	NE_DEBUG(NE_DBG_XML, "Property language is %s\n", prop->lang);
     } else {
 	prop->lang = NULL;
@@ -446,7 +770,7 @@ endelm(void *userdata, const struct ne_xml_elm *elm, const char *cdata)
 
     NE_DEBUG(NE_DBG_XML, "Value of property #%d is %s\n", n, cdata);
     
-    pstat->props[n].value = ne_strdup(cdata);
+    pstat->props[n].value = ne_pool_strdup(hdl->pool, cdata);
 
     return 0;
 }
@@ -455,6 +779,7 @@ static void end_propstat(void *userdata, void *pstat_v,
 			 const ne_status *status,
 			 const char *description)
 {
+    ne_propfind_handler *hdl = userdata;
     struct propstat *pstat = pstat_v;
 
     /* Nothing to do if no status was given. */
@@ -476,45 +801,27 @@ static void end_propstat(void *userdata, void *pstat_v,
 	int n;
 	
 	for (n = 0; n < pstat->numprops; n++) {
-	    ne_free(pstat->props[n].value);
 	    pstat->props[n].value = NULL;
 	}
     }
 
     /* copy the status structure, and dup the reason phrase. */
     pstat->status = *status;
-    pstat->status.reason_phrase = ne_strdup(status->reason_phrase);
+    pstat->status.reason_phrase = 
+	ne_pool_strdup(hdl->pool, status->reason_phrase);
 }
 
-/* Frees up a results set */
+/* Empties a results set, ready for the next response. */
 static void free_propset(ne_propfind_handler *hdl, ne_prop_result_set *set)
 {
-    int n;
-    
-    for (n = 0; n < set->numpstats; n++) {
-	int m;
-	struct propstat *p = &set->pstats[n];
-
-	for (m = 0; m < p->numprops; m++) {
-	    NE_FREE(p->props[m].nspace);
-	    ne_free(p->props[m].name);
-	    NE_FREE(p->props[m].lang);
-	    NE_FREE(p->props[m].value);
-	}
-
-	if (p->status.reason_phrase)
-	    ne_free(p->status.reason_phrase);
-	if (p->props)
-	    ne_free(p->props);
-    }
-
     if (hdl->private_free)
         hdl->private_free(hdl->private_userdata, set->private);
     
-    if (set->pstats)
-	ne_free(set->pstats);
-    ne_free(set->href);
-    ne_free(set);
+    set->numpstats = 0;
+    set->indexed = 0;
+    set->private = NULL;
+    set->href = NULL;
+    ne_pool_clear(hdl->pool);
 }
 
 static void end_response(void *userdata, void *resource,
@@ -537,18 +844,16 @@ static void end_response(void *userdata, void *resource,
     handler->current = NULL;
 }
 
-ne_propfind_handler *
-ne_propfind_create(ne_session *sess, const char *uri, int depth)
+/* Create a handler for the PROPFIND request 'req'. */
+static ne_propfind_handler *create_handler(ne_session *sess, ne_request *req)
 {
     ne_propfind_handler *ret = ne_calloc(sizeof(ne_propfind_handler));
 
     ret->parser = ne_xml_create();
+    ret->pool = ne_pool_create(4096);
     ret->parser207 = ne_207_create(ret->parser, ret);
     ret->sess = sess;
-    ret->body = ne_buffer_create();
-    ret->request = ne_request_create(sess, "PROPFIND", uri);
-
-    ne_add_depth_header(ret->request, depth);
+    ret->request = req;
 
     ne_207_set_response_handlers(ret->parser207, 
 				  start_response, end_response);
@@ -556,10 +861,19 @@ ne_propfind_create(ne_session *sess, const char *uri, int depth)
     ne_207_set_propstat_handlers(ret->parser207, start_propstat,
 				  end_propstat);
 
-    /* The start of the request body is fixed: */
-    ne_buffer_concat(ret->body, 
-		    "<?xml version=\"1.0\" encoding=\"utf-8\"?>" EOL 
-		    "<propfind xmlns=\"DAV:\">", NULL);
+    return ret;
+}
+
+ne_propfind_handler *
+ne_propfind_create(ne_session *sess, const char *uri, int depth)
+{
+    ne_propfind_handler *ret;
+
+    ret = create_handler(sess, ne_request_create(sess, "PROPFIND", uri));
+    ne_add_depth_header(ret->request, depth);
+
+    ret->body = ne_buffer_create();
+    ne_buffer_zappend(ret->body, PROPFIND_START);
 
     return ret;
 }
@@ -567,11 +881,20 @@ ne_propfind_create(ne_session *sess, const char *uri, int depth)
 /* Destroy a propfind handler */
 void ne_propfind_destroy(ne_propfind_handler *handler)
 {
+    int n;
+
     if (handler->current)
         free_propset(handler, handler->current);
+    for (n = 0; n < handler->set.maxpstats; n++)
+	NE_FREE(handler->set.pstats[n].props);
+    NE_FREE(handler->set.pstats);
+    NE_FREE(handler->set.refs);
+    NE_FREE(handler->set.buckets);
+    ne_pool_destroy(handler->pool);
     ne_207_destroy(handler->parser207);
     ne_xml_destroy(handler->parser);
-    ne_buffer_destroy(handler->body);
+    if (handler->body)
+	ne_buffer_destroy(handler->body);
     ne_request_destroy(handler->request);
     ne_free(handler);    
 }
@@ -595,6 +918,41 @@ int ne_simple_propfind(ne_session *sess, const char *href, int depth,
     return ret;
 }
 
+ne_request_template *ne_propfind_template(ne_session *sess, int depth,
+					  const ne_propname *props)
+{
+    ne_request_template *tpl = ne_template_create(sess, "PROPFIND");
+    ne_buffer *body = ne_buffer_create();
+
+    ne_buffer_zappend(body, PROPFIND_START);
+    if (props != NULL) {
+	ne_buffer_zappend(body, "<prop>" EOL);
+	names_body(body, props);
+	ne_buffer_zappend(body, "</prop></propfind>" EOL);
+    } else {
+	ne_buffer_zappend(body, "<allprop/></propfind>" EOL);
+    }
+
+    ne_template_add_header(tpl, "Depth", depth == NE_DEPTH_ZERO ? "0" :
+			   depth == NE_DEPTH_ONE ? "1" : "infinity");
+    ne_template_add_header(tpl, "Content-Type", NE_XML_MEDIA_TYPE);
+    ne_template_set_body(tpl, body->data, ne_buffer_size(body));
+    ne_buffer_destroy(body);
+    return tpl;
+}
+
+int ne_simple_propfind_tpl(ne_request_template *tpl, const char *href,
+			   ne_props_result results, void *userdata)
+{
+    ne_request *req = ne_template_request(tpl, href);
+    ne_propfind_handler *hdl = create_handler(ne_get_session(req), req);
+    int ret;
+
+    ret = propfind(hdl, results, userdata);
+    ne_propfind_destroy(hdl);
+    return ret;
+}
+
 int ne_propnames(ne_session *sess, const char *href, int depth,
 		  ne_props_result results, void *userdata)
 {
@@ -103,7 +103,9 @@ int ne_propset_iterate(const ne_prop_result_set *set,
 
 /* Callback for handling the results of fetching properties for a
  * single resource (named by 'href').  The results are stored in the
- * result set 'results': use ne_propset_* to examine this object.  */
+ * result set 'results': use ne_propset_* to examine this object.
+ * The result set, and every string got from it, is valid only until
+ * the callback returns: it is reused for the next resource.  */
 typedef void (*ne_props_result)(void *userdata, const char *href,
 				 const ne_prop_result_set *results);
 
@@ -127,6 +129,17 @@ int ne_simple_propfind(ne_session *sess, const char *path, int depth,
 			const ne_propname *props,
 			ne_props_result results, void *userdata);
 
+/* For repeating the same PROPFIND on many resources, or many times:
+ * ne_propfind_template returns a template (see ne_request.h) for the
+ * PROPFIND which ne_simple_propfind would send for 'depth' and
+ * 'props', with its body serialized once; ne_simple_propfind_tpl
+ * then sends it for 'path'.  Destroy the template with
+ * ne_template_destroy. */
+ne_request_template *ne_propfind_template(ne_session *sess, int depth,
+					  const ne_propname *props);
+int ne_simple_propfind_tpl(ne_request_template *tpl, const char *path,
+			   ne_props_result results, void *userdata);
+
 /* The properties of a resource can be manipulated using ne_proppatch.
  * A single proppatch request may include any number of individual
  * "set" and "remove" operations, and is defined to have
@@ -153,6 +166,28 @@ typedef struct {
 int ne_proppatch(ne_session *sess, const char *path,
 		 const ne_proppatch_operation *ops);
 
+/* For a PROPPATCH too large to hold in memory: the operations are
+ * given one at a time by an iterator, which fills in 'op' and returns
+ * non-zero, or returns zero once there are no more.  It is called
+ * with 'op' NULL to start again from the first, before each time the
+ * body is sent.  The name and value given need only stay valid until
+ * the next call. */
+typedef int (*ne_proppatch_iterator)(void *userdata,
+				     ne_proppatch_operation *op);
+
+/* As ne_proppatch, but the body is generated from the operations
+ * given by 'iter' as it is sent.  It is sent with chunked
+ * transfer-encoding to an HTTP/1.1 server; otherwise the operations
+ * are gone through once beforehand to find its length. */
+int ne_proppatch_stream(ne_session *sess, const char *path,
+			ne_proppatch_iterator iter, void *userdata);
+
+/* As ne_propfind_template, for the PROPPATCH of 'ops'; send it for
+ * 'path' with ne_proppatch_tpl. */
+ne_request_template *ne_proppatch_template(ne_session *sess, 
+					   const ne_proppatch_operation *ops);
+int ne_proppatch_tpl(ne_request_template *tpl, const char *path);
+
 /* Retrieve property names for the resources at 'path'.  'results'
  * callback is called for each resource.  Use 'ne_propset_iterate' on
  * the passed results object to retrieve the list of property names.
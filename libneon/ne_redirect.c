@@ -40,7 +40,6 @@
 
 struct redirect {
     char *location;
-    char *requri;
     int valid; /* non-zero if .uri contains a redirect */
     ne_uri uri;
     ne_session *sess;
@@ -51,8 +50,9 @@ create(ne_request *req, void *session, const char *method, const char *uri)
 {
     struct redirect *red = session;
     NE_FREE(red->location);
-    NE_FREE(red->requri);
-    red->requri = ne_strdup(uri);
+    /* the URI is kept with the request itself: by post_send, the
+     * last made on the session may be another, or gone. */
+    ne_set_request_private(req, REDIRECT_ID, ne_request_strdup(req, uri));
     ne_add_response_header_handler(req, "Location", ne_duplicate_header,
 				   &red->location);
 }
@@ -73,7 +73,7 @@ static int post_send(ne_request *req, void *private, const ne_status *status)
 	ne_buffer *path = ne_buffer_create();
 	char *pnt;
 	
-	ne_buffer_zappend(path, red->requri);
+	ne_buffer_zappend(path, ne_get_request_private(req, REDIRECT_ID));
 	pnt = strrchr(path->data, '/');
 
 	if (pnt && *(pnt+1) != '\0') {
@@ -112,8 +112,6 @@ static void free_redirect(void *cookie)
     struct redirect *red = cookie;
     NE_FREE(red->location);
     ne_uri_free(&red->uri);
-    if (red->requri)
-        ne_free(red->requri);
     ne_free(red);
 }
 
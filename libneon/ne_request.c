@@ -61,7 +61,6 @@
 #include "ne_uri.h"
 
 #include "ne_private.h"
-#include <sys/time.h>
 
 #define HTTP_EXPECT_TIMEOUT 15
 /* 100-continue only used if size > HTTP_EXPECT_MINSIZ */
@@ -74,15 +73,6 @@
 if (sret < 0) return aborted(req, msg, sret); } while (0)
 
 
-struct timeval g_tv1, g_tv2;
-
-inline static long
-latency(struct timeval tv1, struct timeval tv2)
-{
-    return ((tv2.tv_sec-tv1.tv_sec)*1000000+(tv2.tv_usec-tv1.tv_usec));
-    	
-}
-
 /* This is called with each of the headers in the response */
 struct header_handler {
     char *name;
@@ -105,6 +95,14 @@ struct ne_request_s {
     char *method, *uri; /* method and Request-URI */
 
     ne_buffer *headers; /* request headers */
+    ne_buffer *reqbuf; /* the request as sent, built afresh each time */
+
+    /* Everything else allocated for the request comes from here, and
+     * is given back all at once when it is destroyed.  The pool and
+     * the buffers are kept with the request on the session's list of
+     * spares, for the next one created. */
+    ne_pool *pool;
+    ne_request *next_spare;
 
     /* Request body. */
     ne_provide_body body_cb;
@@ -166,13 +164,33 @@ struct ne_request_s {
     /*** Miscellaneous ***/
     unsigned int method_is_head:1;
     unsigned int use_expect100:1;
+    unsigned int body_chunked:1; /* body sent with chunked encoding */
     unsigned int can_persist:1;
+    unsigned int may_retry:1; /* sent down a persisted connection */
+    unsigned int conn_borrowed:1; /* 'conn' is checked out by another
+				   * request */
 
     ne_session *session;
+    struct ne_conn *conn; /* checked out from the session's pool */
     ne_status status;
+
+    ne_request_timing timing;
+    /* system calls made for the request, and the counts of the
+     * socket when it began to be sent. */
+    ne_sock_stats syscalls, syscalls_start;
+};
+
+struct ne_request_template_s {
+    ne_session *session;
+    char *method;
+    ne_buffer *headers; /* serialized, Content-Length included */
+    char *body;
+    size_t body_size;
 };
 
 static int open_connection(ne_request *req);
+static int conn_checkout(ne_request *req);
+static void conn_checkin(ne_request *req);
 
 /* The iterative step used to produce the hash value.  This is DJB's
  * magic "*33" hash function.  Ralf Engelschall has done some amazing
@@ -229,8 +247,8 @@ static int aborted(ne_request *req, const char *doing, ssize_t code)
 	ne_set_error(sess, "%s", doing);
 	break;
     default:
-	if (sess->socket != NULL) {
-	    const char *err = ne_sock_error(sess->socket);
+	if (req->conn != NULL && req->conn->socket != NULL) {
+	    const char *err = ne_sock_error(req->conn->socket);
 	    ne_set_error(sess, "%s: %s", doing, err);
 	} else {
 	    char err[200];
@@ -239,7 +257,8 @@ static int aborted(ne_request *req, const char *doing, ssize_t code)
 	}
     }
 
-    ne_close_connection(sess);
+    if (req->conn != NULL)
+	ne_close_conn(req->conn);
     return ret;
 }
 
@@ -285,9 +304,11 @@ typedef void (*void_fn)(void);
 
 #define ADD_HOOK(hooks, fn, ud) add_hook(&(hooks), NULL, (void_fn)(fn), (ud))
 
-static void add_hook(struct hook **hooks, const char *id, void_fn fn, void *ud)
+/* Append 'hk' to the list 'hooks'. */
+static void link_hook(struct hook **hooks, struct hook *hk, 
+		      const char *id, void_fn fn, void *ud)
 {
-    struct hook *hk = ne_malloc(sizeof (struct hook)), *pos;
+    struct hook *pos;
 
     if (*hooks != NULL) {
 	for (pos = *hooks; pos->next != NULL; pos = pos->next)
@@ -303,6 +324,11 @@ static void add_hook(struct hook **hooks, const char *id, void_fn fn, void *ud)
     hk->next = NULL;
 }
 
+static void add_hook(struct hook **hooks, const char *id, void_fn fn, void *ud)
+{
+    link_hook(hooks, ne_malloc(sizeof (struct hook)), id, fn, ud);
+}
+
 void ne_hook_create_request(ne_session *sess, 
 			    ne_create_request_fn fn, void *userdata)
 {
@@ -338,7 +364,18 @@ void ne_set_session_private(ne_session *sess, const char *id, void *userdata)
 
 void ne_set_request_private(ne_request *req, const char *id, void *userdata)
 {
-    add_hook(&req->private, id, NULL, userdata);
+    link_hook(&req->private, ne_pool_alloc(req->pool, sizeof (struct hook)),
+	      id, NULL, userdata);
+}
+
+void *ne_request_alloc(ne_request *req, size_t size)
+{
+    return ne_pool_calloc(req->pool, size);
+}
+
+char *ne_request_strdup(ne_request *req, const char *s)
+{
+    return ne_pool_strdup(req->pool, s);
 }
 
 static ssize_t body_string_send(void *userdata, char *buffer, size_t count)
@@ -413,7 +450,7 @@ static int send_with_progress(void *userdata, const char *data, size_t n)
     ne_request *req = userdata;
     int ret;
     
-    ret = ne_sock_fullwrite(req->session->socket, data, n);
+    ret = ne_sock_fullwrite(req->conn->socket, data, n);
     if (ret == 0) {
 	req->body_progress += n;
 	req->session->progress_cb(req->session->progress_ud,
@@ -423,6 +460,30 @@ static int send_with_progress(void *userdata, const char *data, size_t n)
     return ret;    
 }
 
+/* Sends a block of the request body as a chunk. */
+static int send_chunk(void *userdata, const char *data, size_t n)
+{
+    ne_request *req = userdata;
+    struct ne_iovec vec[3];
+    char size[20];
+    int ret;
+
+    ne_snprintf(size, sizeof size, "%lx" EOL, (unsigned long)n);
+    vec[0].base = size;
+    vec[0].len = strlen(size);
+    vec[1].base = data;
+    vec[1].len = n;
+    vec[2].base = EOL;
+    vec[2].len = 2;
+    ret = ne_sock_fullwritev(req->conn->socket, vec, 3);
+    if (ret == 0 && req->session->progress_cb) {
+	req->body_progress += n;
+	req->session->progress_cb(req->session->progress_ud,
+				  req->body_progress, -1);
+    }
+    return ret;
+}
+
 /* Sends the request body down the socket.
  * Returns 0 on success, or NE_* code */
 static int send_request_body(ne_request *req)
@@ -430,14 +491,25 @@ static int send_request_body(ne_request *req)
     int ret; 
 
     NE_DEBUG(NE_DBG_HTTP, "Sending request body...\n");
-    if (req->session->progress_cb) {
+    if (req->body_chunked) {
+	/* chunk by chunk, then the last, empty, chunk. */
+	req->body_progress = 0;
+	ret = ne_pull_request_body(req, send_chunk, req);
+	if (ret == 0)
+	    ret = ne_sock_fullwrite(req->conn->socket, "0" EOL EOL, 5);
+    } else if (req->body_cb == body_fd_send && !req->session->progress_cb) {
+	/* straight from the file, without copying it through here
+	 * where the socket allows. */
+	ret = ne_sock_sendfile(req->conn->socket, req->body.fd, 0, 
+			       req->body_size);
+    } else if (req->session->progress_cb) {
 	/* with progress callbacks. */
 	req->body_progress = 0;
 	ret = ne_pull_request_body(req, send_with_progress, req);
     } else {
 	/* without progress callbacks. */
 	ret = ne_pull_request_body(req, (ne_push_fn)ne_sock_fullwrite,
-				   req->session->socket);
+				   req->conn->socket);
     }
 
     NE_DEBUG(NE_DBG_HTTP, "Request body sent: %s.\n", ret?"failed":"okay");
@@ -508,21 +580,46 @@ static void clength_hdr_handler(void *userdata, const char *value)
     }
 }
 
+/* most destroyed requests a session keeps for reuse. */
+#define MAX_SPARE_REQS (4)
+/* size of the blocks of the request pools: enough for the handlers
+ * and privates of a typical request, with redirects, auth and
+ * locks. */
+#define REQ_POOL_SIZE (1024)
+
 ne_request *ne_request_create(ne_session *sess,
 			      const char *method, const char *path) 
 {
-    ne_request *req = ne_calloc(sizeof *req);
+    ne_request *req = sess->spare_reqs;
 
     NE_DEBUG(NE_DBG_HTTP, "Creating request...\n");
 
+    if (req) {
+	/* reuse a spare, along with its pool and buffers. */
+	ne_pool *pool = req->pool;
+	ne_buffer *headers = req->headers, *reqbuf = req->reqbuf;
+
+	sess->spare_reqs = req->next_spare;
+	sess->nspare_reqs--;
+	memset(req, 0, sizeof *req);
+	req->pool = pool;
+	req->headers = headers;
+	req->reqbuf = reqbuf;
+	ne_buffer_clear(req->headers);
+    } else {
+	req = ne_calloc(sizeof *req);
+	req->pool = ne_pool_create(REQ_POOL_SIZE);
+	req->headers = ne_buffer_create();
+	req->reqbuf = ne_buffer_create();
+    }
+
     req->session = sess;
-    req->headers = ne_buffer_create();
 
     /* Add in the fixed headers */
     add_fixed_headers(req);
 
     /* Set the standard stuff */
-    req->method = ne_strdup(method);
+    req->method = ne_pool_strdup(req->pool, method);
     req->method_is_head = (strcmp(method, "HEAD") == 0);
 
     /* Add in handlers for all the standard HTTP headers. */
@@ -535,11 +632,14 @@ ne_request *ne_request_create(ne_session *sess,
 
     /* Only use an absoluteURI here when absolutely necessary: some
      * servers can't parse them. */
-    if (req->session->use_proxy && !req->session->use_ssl && path[0] == '/')
-	req->uri = ne_concat(req->session->scheme, "://", 
-			     req->session->server.hostport, path, NULL);
-    else
-	req->uri = ne_strdup(path);
+    if (req->session->use_proxy && !req->session->use_ssl && path[0] == '/') {
+	size_t len = strlen(sess->scheme) + strlen(sess->server.hostport)
+	    + strlen(path) + 4;
+	req->uri = ne_pool_alloc(req->pool, len);
+	ne_snprintf(req->uri, len, "%s://%s%s", sess->scheme,
+		    sess->server.hostport, path);
+    } else
+	req->uri = ne_pool_strdup(req->pool, path);
 
     {
 	struct hook *hk;
@@ -557,6 +657,58 @@ ne_request *ne_request_create(ne_session *sess,
     return req;
 }
 
+ne_request_template *ne_template_create(ne_session *sess, const char *method)
+{
+    ne_request_template *tpl = ne_calloc(sizeof *tpl);
+
+    tpl->session = sess;
+    tpl->method = ne_strdup(method);
+    tpl->headers = ne_buffer_create();
+    return tpl;
+}
+
+void ne_template_add_header(ne_request_template *tpl, const char *name,
+			    const char *value)
+{
+    ne_buffer_concat(tpl->headers, name, ": ", value, EOL, NULL);
+}
+
+void ne_template_set_body(ne_request_template *tpl, const char *body,
+			  size_t size)
+{
+    char len[32];
+
+    NE_FREE(tpl->body);
+    tpl->body = ne_malloc(size);
+    memcpy(tpl->body, body, size);
+    tpl->body_size = size;
+    ne_snprintf(len, sizeof len, "%" NE_FMT_SIZE_T, size);
+    ne_template_add_header(tpl, "Content-Length", len);
+}
+
+ne_request *ne_template_request(ne_request_template *tpl, const char *path)
+{
+    ne_request *req = ne_request_create(tpl->session, tpl->method, path);
+
+    ne_buffer_append(req->headers, tpl->headers->data, 
+		     ne_buffer_size(tpl->headers));
+    if (tpl->body) {
+	req->body.buf.buffer = tpl->body;
+	req->body_cb = body_string_send;
+	req->body_ud = req;
+	req->body_size = tpl->body_size;
+    }
+    return req;
+}
+
+void ne_template_destroy(ne_request_template *tpl)
+{
+    ne_free(tpl->method);
+    ne_buffer_destroy(tpl->headers);
+    NE_FREE(tpl->body);
+    ne_free(tpl);
+}
+
 static void set_body_size(ne_request *req, size_t size)
 {
     req->body_size = size;
@@ -580,6 +732,15 @@ void ne_set_request_body_provider(ne_request *req, size_t bodysize,
     set_body_size(req, bodysize);
 }
 
+void ne_set_request_body_provider_chunked(ne_request *req,
+					  ne_provide_body provider, void *ud)
+{
+    req->body_cb = provider;
+    req->body_ud = ud;
+    req->body_chunked = 1;
+    ne_add_request_header(req, "Transfer-Encoding", "chunked");
+}
+
 int ne_set_request_body_fd(ne_request *req, int fd)
 {
     struct stat bodyst;
@@ -623,9 +784,9 @@ void
 ne_add_response_header_handler(ne_request *req, const char *name, 
 			       ne_header_handler hdl, void *userdata)
 {
-    struct header_handler *new = ne_calloc(sizeof *new);
+    struct header_handler *new = ne_pool_calloc(req->pool, sizeof *new);
     unsigned int hash;
-    new->name = ne_strdup(name);
+    new->name = ne_pool_strdup(req->pool, name);
     new->handler = hdl;
     new->userdata = userdata;
     hash = hash_and_lower(new->name);
@@ -636,7 +797,7 @@ ne_add_response_header_handler(ne_request *req, const char *name,
 void ne_add_response_header_catcher(ne_request *req, 
 				    ne_header_handler hdl, void *userdata)
 {
-    struct header_handler *new = ne_calloc(sizeof *new);
+    struct header_handler *new = ne_pool_calloc(req->pool, sizeof *new);
     new->handler = hdl;
     new->userdata = userdata;
     new->next = req->header_catchers;
@@ -646,7 +807,7 @@ void ne_add_response_header_catcher(ne_request *req,
 void ne_add_response_body_reader(ne_request *req, ne_accept_response acpt,
 				 ne_block_reader rdr, void *userdata)
 {
-    struct body_reader *new = ne_malloc(sizeof *new);
+    struct body_reader *new = ne_pool_alloc(req->pool, sizeof *new);
     new->accept_response = acpt;
     new->handler = rdr;
     new->userdata = userdata;
@@ -654,53 +815,52 @@ void ne_add_response_body_reader(ne_request *req, ne_accept_response acpt,
     req->body_readers = new;
 }
 
-void ne_request_destroy(ne_request *req) 
+static void free_request(ne_request *req)
 {
-    struct body_reader *rdr, *next_rdr;
-    struct header_handler *hdlr, *next_hdlr;
-    struct hook *hk, *next_hk;
-    int n;
-
-    ne_free(req->uri);
-    ne_free(req->method);
-
-    for (rdr = req->body_readers; rdr != NULL; rdr = next_rdr) {
-	next_rdr = rdr->next;
-	ne_free(rdr);
-    }
-
-    for (hdlr = req->header_catchers; hdlr != NULL; hdlr = next_hdlr) {
-	next_hdlr = hdlr->next;
-	ne_free(hdlr);
-    }
+    ne_buffer_destroy(req->headers);
+    ne_buffer_destroy(req->reqbuf);
+    ne_pool_destroy(req->pool);
+    ne_free(req);
+}
 
-    for (n = 0; n < HH_HASHSIZE; n++) {
-	for (hdlr = req->header_handlers[n]; hdlr != NULL; 
-	     hdlr = next_hdlr) {
-	    next_hdlr = hdlr->next;
-	    ne_free(hdlr->name);
-	    ne_free(hdlr);
-	}
-    }
+void ne_request_destroy(ne_request *req) 
+{
+    ne_session *sess = req->session;
+    struct hook *hk;
 
-    ne_buffer_destroy(req->headers);
+    conn_checkin(req);
 
     NE_DEBUG(NE_DBG_HTTP, "Running destroy hooks.\n");
-    for (hk = req->session->destroy_req_hooks; hk; hk = hk->next) {
+    for (hk = sess->destroy_req_hooks; hk; hk = hk->next) {
 	ne_destroy_req_fn fn = (ne_destroy_req_fn)hk->fn;
 	fn(req, hk->userdata);
     }
 
-    for (hk = req->private; hk; hk = next_hk) {
-	next_hk = hk->next;
-	ne_free(hk);
-    }
-
     if (req->status.reason_phrase)
 	ne_free(req->status.reason_phrase);
 
+    /* The handlers, readers and privates all went in the pool. */
+    ne_pool_clear(req->pool);
+
     NE_DEBUG(NE_DBG_HTTP, "Request ends.\n");
-    ne_free(req);
+    if (sess->nspare_reqs < MAX_SPARE_REQS) {
+	req->next_spare = sess->spare_reqs;
+	sess->spare_reqs = req;
+	sess->nspare_reqs++;
+    } else {
+	free_request(req);
+    }
+}
+
+void ne_free_spare_requests(ne_session *sess)
+{
+    ne_request *req;
+
+    while ((req = sess->spare_reqs) != NULL) {
+	sess->spare_reqs = req->next_spare;
+	free_request(req);
+    }
+    sess->nspare_reqs = 0;
 }
 
 
@@ -713,7 +873,7 @@ static int read_response_block(ne_request *req, struct ne_response *resp,
 {
     size_t willread;
     ssize_t readlen;
-    ne_socket *sock = req->session->socket;
+    ne_socket *sock = req->conn->socket;
     switch (resp->mode) {
     case R_CHUNKED:
 	/* We are doing a chunked transfer-encoding.
@@ -816,6 +976,9 @@ ssize_t ne_read_response_block(ne_request *req, char *buffer, size_t buflen)
 
     req->resp.total += readlen;
 
+    if (readlen == 0)
+	req->timing.body_done = ne_hrtime_now();
+
     if (req->session->progress_cb) {
 	req->session->progress_cb(req->session->progress_ud, req->resp.total, 
 				  (req->resp.mode==R_CLENGTH)?req->resp.length:-1);
@@ -829,11 +992,77 @@ ssize_t ne_read_response_block(ne_request *req, char *buffer, size_t buflen)
     return readlen;
 }
 
-/* Build the request string, returning the buffer. */
+/* Write 'len' bytes of response body at 'data' to 'fd', if not -1.
+ * Returns NE_OK, or NE_ERROR having closed the connection. */
+static int write_body_block(ne_request *req, int fd, const char *data,
+			    size_t len)
+{
+    ssize_t ret;
+
+    while (fd >= 0 && len > 0) {
+	ret = write(fd, data, len);
+	if (ret < 0 && errno == EINTR)
+	    continue;
+	if (ret < 0) {
+	    char err[200], msg[256];
+	    ne_strerror(errno, err, sizeof err);
+	    ne_snprintf(msg, sizeof msg, _("Could not write to file: %s"), err);
+	    return aborted(req, msg, 0);
+	}
+	data += ret;
+	len -= ret;
+    }
+    return NE_OK;
+}
+
+int ne_read_response_to_fd(ne_request *req, int fd)
+{
+    size_t len;
+    int ret;
+
+    if (req->resp.mode == R_CLENGTH && !req->session->progress_cb) {
+	/* the length is known, so the socket code can move it all. */
+	ssize_t sret = ne_sock_splice(req->conn->socket, fd, req->resp.left);
+	if (sret < 0)
+	    return aborted(req, _("Could not read response body"), sret);
+	req->resp.total += req->resp.left;
+	req->resp.left = 0;
+	req->timing.body_done = ne_hrtime_now();
+	return NE_OK;
+    }
+
+    do {
+	len = sizeof req->respbuf;
+	if (read_response_block(req, &req->resp, req->respbuf, &len))
+	    return NE_ERROR;
+	req->resp.total += len;
+	if (req->session->progress_cb)
+	    req->session->progress_cb(req->session->progress_ud, 
+				      req->resp.total, 
+				      (req->resp.mode == R_CLENGTH)
+				      ? req->resp.length : -1);
+	ret = write_body_block(req, fd, req->respbuf, len);
+	if (ret)
+	    return ret;
+    } while (len > 0);
+
+    req->timing.body_done = ne_hrtime_now();
+    return NE_OK;
+}
+
+off_t ne_get_response_length(const ne_request *req)
+{
+    return req->resp.total;
+}
+
+/* Build the request string, returning the buffer; it belongs to the
+ * request. */
 static ne_buffer *build_request(ne_request *req) 
 {
     struct hook *hk;
-    ne_buffer *buf = ne_buffer_create();
+    ne_buffer *buf = req->reqbuf;
+
+    ne_buffer_clear(buf);
 
     /* Add Request-Line and Host header: */
     ne_buffer_concat(buf, req->method, " ", req->uri, " HTTP/1.1" EOL,
@@ -911,11 +1140,14 @@ static int read_status_line(ne_request *req, ne_status *status, int retry)
     char *buffer = req->respbuf;
     ssize_t ret;
 
-    ret = ne_sock_readline(req->session->socket, buffer, sizeof req->respbuf);
+    ret = ne_sock_readline(req->conn->socket, buffer, sizeof req->respbuf);
     if (ret <= 0) {
 	int aret = aborted(req, _("Could not read status line"), ret);
 	return RETRY_RET(retry, ret, aret);
     }
+
+    if (req->timing.first_byte == 0)
+	req->timing.first_byte = ne_hrtime_now();
     
     NE_DEBUG(NE_DBG_HTTP, "[status-line] < %s", buffer);
     strip_eol(buffer, &ret);
@@ -933,7 +1165,7 @@ static int read_status_line(ne_request *req, ne_status *status, int retry)
 static int discard_headers(ne_request *req)
 {
     do {
-	SOCK_ERR(req, ne_sock_readline(req->session->socket, req->respbuf, 
+	SOCK_ERR(req, ne_sock_readline(req->conn->socket, req->respbuf, 
 				       sizeof req->respbuf),
 		 _("Could not read interim response headers"));
 	NE_DEBUG(NE_DBG_HTTP, "[discard] < %s", req->respbuf);
@@ -941,41 +1173,53 @@ static int discard_headers(ne_request *req)
     return NE_OK;
 }
 
-/* Send the request, and read the response Status-Line. Returns:
- *   NE_RETRY   connection closed by server; persistent connection
- *		timeout
- *   NE_OK	success
- *   NE_*	error
- * On NE_RETRY and NE_* responses, the connection will have been 
- * closed already.
- */
-static int send_request(ne_request *req, const ne_buffer *request)
+/* Send the Request-Line and headers, and the request body unless
+ * 100-continue is used, reading nothing of the response.  Returns
+ * NE_RETRY, NE_OK or NE_* as send_request. */
+static int write_request(ne_request *req, const ne_buffer *request)
 {
     ne_session *sess = req->session;
-    ssize_t ret = NE_OK;
-    int sentbody = 0, retry;
-    ne_status *status = &req->status;
-    struct timeval tv1, tv2;
+    ne_socket *sock;
+    ssize_t ret;
+    int sendbody = !req->use_expect100 
+	&& (req->body_size > 0 || req->body_chunked);
 
     /* Send the Request-Line and headers */
     NE_DEBUG(NE_DBG_HTTP, "Sending request-line and headers:\n");
     /* Open the connection if necessary */
     HTTP_ERR(open_connection(req));
+    sock = req->conn->socket;
 
     /* Allow retry if a persistent connection has been used. */
-    retry = sess->persisted;
+    req->may_retry = req->conn->persisted;
+    req->syscalls_start = *ne_sock_get_stats(sock);
+
+    if (sess->cork)
+	ne_sock_cork(sock, 1);
     
-    ret = ne_sock_fullwrite(req->session->socket, request->data, 
-			    ne_buffer_size(request));
+    if (sendbody && req->body_cb == body_string_send && !sess->progress_cb) {
+	/* A body held in memory goes out with the headers, in a
+	 * single write. */
+	struct ne_iovec vec[2];
+
+	vec[0].base = request->data;
+	vec[0].len = ne_buffer_size(request);
+	vec[1].base = req->body.buf.buffer;
+	vec[1].len = req->body_size;
+	ret = ne_sock_fullwritev(sock, vec, 2);
+	sendbody = 0;
+    } else {
+	ret = ne_sock_fullwrite(sock, request->data, ne_buffer_size(request));
+    }
     if (ret < 0) {
 	int aret = aborted(req, _("Could not send request"), ret);
-	return RETRY_RET(retry, ret, aret);
+	return RETRY_RET(req->may_retry, ret, aret);
     }
     
     /* FIXME: probably due to Nagle, the write above may or may not
      * have been delayed, so retry is left at 1 here. */
     
-    if (!req->use_expect100 && req->body_size > 0) {
+    if (sendbody) {
 	/* Send request body, if not using 100-continue. */
 	ret = send_request_body(req);
 	if (ret < 0) {
@@ -983,8 +1227,32 @@ static int send_request(ne_request *req, const ne_buffer *request)
 	    return RETRY_RET(sess, ret, aret);
 	}
     }
+
+    /* out with whatever the cork held back. */
+    if (sess->cork)
+	ne_sock_cork(sock, 0);
     
-    NE_DEBUG(NE_DBG_HTTP, "Request sent; retry is %d\n", retry);
+    req->timing.send_done = ne_hrtime_now();
+    NE_DEBUG(NE_DBG_HTTP, "Request sent; retry is %d\n", req->may_retry);
+    return NE_OK;
+}
+
+/* Send the request, and read the response Status-Line. Returns:
+ *   NE_RETRY   connection closed by server; persistent connection
+ *		timeout
+ *   NE_OK	success
+ *   NE_*	error
+ * On NE_RETRY and NE_* responses, the connection will have been 
+ * closed already.
+ */
+static int send_request(ne_request *req, const ne_buffer *request)
+{
+    ssize_t ret = NE_OK;
+    int sentbody = 0, retry;
+    ne_status *status = &req->status;
+
+    HTTP_ERR(write_request(req, request));
+    retry = req->may_retry;
 
     /* Loop eating interim 1xx responses (RFC2616 says these MAY be
      * sent by the server, even if 100-continue is not used). */
@@ -1000,6 +1268,7 @@ static int send_request(ne_request *req, const ne_buffer *request)
 	    /* Send the body after receiving the first 100 Continue */
 	    if ((ret = send_request_body(req)) != NE_OK) break;	    
 	    sentbody = 1;
+	    req->timing.send_done = ne_hrtime_now();
 	}
     }
 
@@ -1016,7 +1285,7 @@ static int send_request(ne_request *req, const ne_buffer *request)
 static int read_message_header(ne_request *req, char *buf, size_t buflen)
 {
     ssize_t n;
-    ne_socket *sock = req->session->socket;
+    ne_socket *sock = req->conn->socket;
 
     n = ne_sock_readline(sock, buf, buflen);
     if (n <= 0)
@@ -1137,7 +1406,7 @@ static int lookup_host(ne_session *sess, struct host_info *info)
     NE_DEBUG(NE_DBG_HTTP, "Doing DNS lookup on %s...\n", info->hostname);
     if (sess->notify_cb)
 	sess->notify_cb(sess->notify_ud, ne_conn_namelookup, info->hostname);
-    info->address = ne_addr_resolve(info->hostname, 0);
+    info->address = ne_addr_resolve_cached(info->hostname, sess->addr_flags);
     if (ne_addr_result(info->address)) {
 	char buf[256];
 	ne_set_error(sess, _("Could not resolve hostname `%s': %s"), 
@@ -1151,13 +1420,11 @@ static int lookup_host(ne_session *sess, struct host_info *info)
     }
 }
 
-int ne_begin_request(ne_request *req)
+/* Get ready to send the request: resolve the hostname if necessary,
+ * and start the clock.  Returns NE_* code. */
+static int prepare_request(ne_request *req)
 {
-    struct body_reader *rdr;
     struct host_info *host;
-    ne_buffer *data;
-    const ne_status *const st = &req->status;
-    int ret, i;
 
     /* Resolve hostname if necessary. */
     host = req->session->use_proxy?&req->session->proxy:&req->session->server;
@@ -1165,25 +1432,19 @@ int ne_begin_request(ne_request *req)
 	HTTP_ERR(lookup_host(req->session, host));
 
     req->resp.mode = R_TILLEOF;
-    
-    /* FIXME: Determine whether to use the Expect: 100-continue header. */
-    req->use_expect100 = (req->session->expect100_works > -1) &&
-	(req->body_size > HTTP_EXPECT_MINSIZE) && req->session->is_http11;
+    req->resp.total = 0;
 
-    /* Build the request string, and send it */
-    data = build_request(req);
-    DEBUG_DUMP_REQUEST(data->data);
-
-	gettimeofday(&g_tv1, NULL);
-    ret = send_request(req, data);
+    memset(&req->timing, 0, sizeof req->timing);
+    req->timing.send_start = ne_hrtime_now();
+    return NE_OK;
+}
 
-    /* Retry this once after a persistent connection timeout. */
-    if (ret == NE_RETRY && !req->session->no_persist) {
-	NE_DEBUG(NE_DBG_HTTP, "Persistent connection timed out, retrying.\n");
-	ret = send_request(req, data);
-    }
-    ne_buffer_destroy(data);
-    if (ret != NE_OK) return ret;
+/* Handle the response once its final Status-Line has been read: read
+ * the headers, and get ready for the response body. */
+static int begin_response(ne_request *req)
+{
+    struct body_reader *rdr;
+    const ne_status *const st = &req->status;
 
     if (st->major_version > 1 || 
 	(st->major_version == 1 && st->minor_version > 0))
@@ -1197,6 +1458,7 @@ int ne_begin_request(ne_request *req)
 
     /* Read the headers */
     HTTP_ERR(read_response_headers(req));
+    req->timing.headers_done = ne_hrtime_now();
 
 #ifdef NEON_SSL
     /* Special case for CONNECT handling: the response has no body,
@@ -1225,6 +1487,112 @@ int ne_begin_request(ne_request *req)
     return NE_OK;
 }
 
+int ne_begin_request(ne_request *req)
+{
+    ne_buffer *data;
+    int ret;
+
+    HTTP_ERR(prepare_request(req));
+    
+    /* FIXME: Determine whether to use the Expect: 100-continue header. */
+    req->use_expect100 = (req->session->expect100_works > -1) &&
+	(req->body_size > HTTP_EXPECT_MINSIZE) && req->session->is_http11;
+
+    /* Build the request string, and send it */
+    data = build_request(req);
+    DEBUG_DUMP_REQUEST(data->data);
+
+    ret = send_request(req, data);
+
+    /* Retry this once after a persistent connection timeout. */
+    if (ret == NE_RETRY && !req->session->no_persist) {
+	NE_DEBUG(NE_DBG_HTTP, "Persistent connection timed out, retrying.\n");
+	ret = send_request(req, data);
+    }
+    if (ret != NE_OK) return ret;
+
+    return begin_response(req);
+}
+
+int ne_begin_send(ne_request *req)
+{
+    ne_buffer *data;
+    int ret;
+
+    HTTP_ERR(prepare_request(req));
+
+    /* The response is only read once it arrives, so there is no
+     * waiting for a 100 Continue before sending the body. */
+    req->use_expect100 = 0;
+
+    data = build_request(req);
+    DEBUG_DUMP_REQUEST(data->data);
+
+    ret = write_request(req, data);
+    return ret;
+}
+
+int ne_begin_response(ne_request *req)
+{
+    ne_status *status = &req->status;
+    int ret;
+
+    /* Skip any interim 1xx responses; these are read synchronously. */
+    while ((ret = read_status_line(req, status, req->may_retry)) == NE_OK
+	   && status->klass == 1) {
+	NE_DEBUG(NE_DBG_HTTP, "Interim %d response.\n", status->code);
+	req->may_retry = 0;
+	HTTP_ERR(discard_headers(req));
+    }
+    if (ret != NE_OK) return ret;
+
+    return begin_response(req);
+}
+
+int ne_response_ready(ne_request *req, enum ne_resp_part part)
+{
+    ne_socket *sock = req->conn->socket;
+    size_t avail = ne_sock_pending(sock);
+
+    switch (part) {
+    case ne_resp_head:
+	/* the Status-Line and all the headers; or as much as can be
+	 * buffered of them, the rest is read synchronously. */
+	return ne_sock_buffered(sock, "\n\r\n") >= 0 
+	    || ne_sock_buffered(sock, "\n\n") >= 0
+	    || ne_sock_buffer_full(sock);
+    case ne_resp_body:
+	switch (req->resp.mode) {
+	case R_CHUNKED:
+	    /* as with the head, a full buffer has to do: what is
+	     * missing is then read synchronously. */
+	    if (ne_sock_buffer_full(sock))
+		return 1;
+	    if (req->resp.chunk_left == 0)
+		return ne_sock_buffered(sock, "\n") >= 0;
+	    /* a read which completes the chunk goes on to read the CRLF
+	     * after it. */
+	    return avail < req->resp.chunk_left ? avail > 0 
+		: avail >= req->resp.chunk_left + 2;
+	case R_CLENGTH:
+	    return avail > 0 || req->resp.left == 0;
+	case R_TILLEOF:
+	    return avail > 0;
+	default:
+	    return 1;
+	}
+    case ne_resp_trailer:
+	if (req->resp.mode != R_CHUNKED)
+	    return 1;
+	/* an empty line, either straight away or after some trailer
+	 * headers. */
+	return ne_sock_buffered(sock, EOL) == 0
+	    || ne_sock_buffered(sock, "\n\r\n") >= 0
+	    || ne_sock_buffer_full(sock);
+    }
+    return 1;
+}
+
 int ne_end_request(ne_request *req)
 {
     struct hook *hk;
@@ -1233,6 +1601,16 @@ int ne_end_request(ne_request *req)
     /* Read headers in chunked trailers */
     if (req->resp.mode == R_CHUNKED)
 	HTTP_ERR(read_response_headers(req));
+
+    if (req->conn->socket) {
+	const ne_sock_stats *st = ne_sock_get_stats(req->conn->socket);
+	req->syscalls.reads = st->reads - req->syscalls_start.reads;
+	req->syscalls.writes = st->writes - req->syscalls_start.writes;
+	req->syscalls.waits = st->waits - req->syscalls_start.waits;
+	req->syscalls.segments = st->segments - req->syscalls_start.segments;
+    }
+    req->session->last_timing = req->timing;
+    req->session->last_syscalls = req->syscalls;
     
     NE_DEBUG(NE_DBG_HTTP, "Running post_send hooks\n");
     for (hk = req->session->post_send_hooks; 
@@ -1244,9 +1622,11 @@ int ne_end_request(ne_request *req)
     /* Close the connection if persistent connections are disabled or
      * not supported by the server. */
     if (req->session->no_persist || !req->can_persist)
-	ne_close_connection(req->session);
+	ne_close_conn(req->conn);
     else
-	req->session->persisted = 1;
+	req->conn->persisted = 1;
+
+    conn_checkin(req);
     
     return ret;
 }
@@ -1272,7 +1652,6 @@ int ne_request_dispatch(ne_request *req)
 	if (len < 0) {
 	    return NE_ERROR;
 	}
-	gettimeofday(&g_tv2, NULL);
 
 	ret = ne_end_request(req);
 
@@ -1285,6 +1664,144 @@ int ne_request_dispatch(ne_request *req)
     return ret;
 }
 
+/* Returns non-zero if a request using 'method' may safely be sent
+ * again should the connection close before its response arrives. */
+static int is_idempotent(const char *method)
+{
+    static const char *const methods[] = {
+	"GET", "HEAD", "OPTIONS", "TRACE", "PROPFIND", NULL
+    };
+    int n;
+
+    for (n = 0; methods[n] != NULL; n++)
+	if (strcmp(method, methods[n]) == 0)
+	    return 1;
+    return 0;
+}
+
+int ne_pipeline_dispatch(ne_request **reqs, int count, int depth)
+{
+    ne_session *sess;
+    struct ne_conn *conn;
+    ne_request *req;
+    int *result, sent = 0, done = 0, served = 0, resent = 0;
+    int n, ret = NE_OK;
+
+    if (count == 0)
+	return NE_OK;
+
+    sess = reqs[0]->session;
+    for (n = 0; n < count && depth > 1; n++)
+	if (!is_idempotent(reqs[n]->method))
+	    depth = 1;
+
+    if (depth < 2 || sess->no_persist) {
+	for (n = 0; n < count; n++) {
+	    int r = ne_request_dispatch(reqs[n]);
+	    if (r != NE_OK && ret == NE_OK)
+		ret = r;
+	}
+	return ret;
+    }
+
+    /* The pipeline holds the one connection throughout, and each
+     * request borrows it. */
+    HTTP_ERR(conn_checkout(reqs[0]));
+    conn = reqs[0]->conn;
+    reqs[0]->conn = NULL;
+
+    result = ne_calloc(count * sizeof *result);
+
+    while (done < count) {
+	/* Keep up to 'depth' requests outstanding. */
+	while (sent < count && sent - done < depth) {
+	    req = reqs[sent];
+	    req->conn = conn;
+	    req->conn_borrowed = 1;
+	    n = ne_begin_send(req);
+	    if (n != NE_OK)
+		break;
+	    /* Those written behind another may always be sent again,
+	     * since they are idempotent. */
+	    if (sent > done)
+		req->may_retry = 1;
+	    sent++;
+	}
+
+	if (sent < count && sent - done < depth) {
+	    /* Sending failed, which closed the connection. */
+	    if (sent > done || (n == NE_RETRY && !resent)) {
+		NE_DEBUG(NE_DBG_HTTP, "Pipeline lost, resending.\n");
+		resent = sent == done;
+		sent = done;
+		depth = 1;
+	    } else {
+		result[done++] = n;
+		sent = done;
+		resent = 0;
+	    }
+	    served = 0;
+	    continue;
+	}
+
+	/* Read the response to the oldest request outstanding. */
+	req = reqs[done];
+	n = ne_begin_response(req);
+	if (n == NE_RETRY && !resent) {
+	    /* The connection closed before the response; send it and
+	     * any others outstanding again, one at a time from now
+	     * on. */
+	    NE_DEBUG(NE_DBG_HTTP, "Pipeline closed, resending.\n");
+	    resent = 1;
+	    sent = done;
+	    depth = 1;
+	    served = 0;
+	    continue;
+	} else if (n == NE_RETRY) {
+	    n = NE_ERROR;
+	} else if (n == NE_OK) {
+	    ssize_t len;
+
+	    do {
+		len = ne_read_response_block(req, req->respbuf,
+					     sizeof req->respbuf);
+	    } while (len > 0);
+	    n = len < 0 ? NE_ERROR : ne_end_request(req);
+	}
+	result[done++] = n;
+	resent = 0;
+	served++;
+
+	if (!conn->connected && sent > done) {
+	    /* The connection was closed by the server after this
+	     * response, or after an error: the requests behind it are
+	     * lost, so send them again.  A server which will not
+	     * persist at all gets them one at a time. */
+	    NE_DEBUG(NE_DBG_HTTP, "Pipeline closed after %d responses, "
+		     "resending %d.\n", served, sent - done);
+	    if (served < 2)
+		depth = 1;
+	    sent = done;
+	    served = 0;
+	}
+    }
+
+    conn->in_use = 0;
+    conn->last_used = ne_hrtime_now();
+
+    /* Requests which need authentication are sent again now, with
+     * the credentials. */
+    for (n = 0; n < count; n++) {
+	if (result[n] == NE_RETRY)
+	    result[n] = ne_request_dispatch(reqs[n]);
+	if (result[n] != NE_OK && ret == NE_OK)
+	    ret = result[n];
+    }
+
+    ne_free(result);
+    return ret;
+}
+
 const ne_status *ne_get_status(const ne_request *req)
 {
     return &req->status;
@@ -1295,11 +1812,32 @@ ne_session *ne_get_session(const ne_request *req)
     return req->session;
 }
 
+const ne_request_timing *ne_get_request_timing(const ne_request *req)
+{
+    return &req->timing;
+}
+
+const ne_sock_stats *ne_get_request_syscalls(const ne_request *req)
+{
+    return &req->syscalls;
+}
+
+const ne_sock_stats *ne_get_last_syscalls(ne_session *sess)
+{
+    return &sess->last_syscalls;
+}
+
+const ne_request_timing *ne_get_last_timing(ne_session *sess)
+{
+    return &sess->last_timing;
+}
+
 #ifdef NEON_SSL
 /* Create a CONNECT tunnel through the proxy server.
  * Returns HTTP_* */
-static int proxy_tunnel(ne_session *sess)
+static int proxy_tunnel(ne_request *outer)
 {
+    ne_session *sess = outer->session;
     /* Hack up an HTTP CONNECT request... */
     ne_request *req;
     int ret = NE_OK;
@@ -1309,14 +1847,18 @@ static int proxy_tunnel(ne_session *sess)
     ne_snprintf(ruri, sizeof ruri, "%s:%u", sess->server.hostname,  
 		sess->server.port);
     req = ne_request_create(sess, "CONNECT", ruri);
+    /* ...to go down the connection just opened for 'outer'. */
+    req->conn = outer->conn;
+    req->conn_borrowed = 1;
 
     sess->in_connect = 1;
     ret = ne_request_dispatch(req);
     sess->in_connect = 0;
 
-    sess->persisted = 0; /* don't treat this is a persistent connection. */
+    /* don't treat this is a persistent connection. */
+    outer->conn->persisted = 0;
 
-    if (ret != NE_OK || !sess->connected || req->status.klass != 2) {
+    if (ret != NE_OK || !outer->conn->connected || req->status.klass != 2) {
 	ne_set_error
 	    (sess, _("Could not create SSL connection through proxy server"));
 	ret = NE_ERROR;
@@ -1327,45 +1869,144 @@ static int proxy_tunnel(ne_session *sess)
 }
 #endif
 
+/* Check out a connection from the session's pool for 'req': the
+ * open one used most recently if any are idle, else one to be
+ * opened.  Returns NE_OK, or NE_ERROR if every connection the
+ * session may have is in use. */
+static int conn_checkout(ne_request *req)
+{
+    ne_session *sess = req->session;
+    struct ne_conn *conn, *best = NULL;
+    ne_hrtime now = ne_hrtime_now();
+
+    for (conn = sess->conns; conn != NULL; conn = conn->next) {
+	if (conn->in_use)
+	    continue;
+	if (conn->connected && sess->idle_timeout > 0
+	    && now - conn->last_used 
+	       > sess->idle_timeout * (ne_hrtime)1000000000) {
+	    NE_DEBUG(NE_DBG_HTTP, "Closing idle connection.\n");
+	    ne_close_conn(conn);
+	}
+	if (best == NULL || (conn->connected && !best->connected) 
+	    || (conn->connected == best->connected
+		&& conn->last_used > best->last_used))
+	    best = conn;
+    }
+
+    if (best == NULL) {
+	if (sess->nconns >= sess->max_conns) {
+	    ne_set_error(sess, _("All %d connections are in use"),
+			 sess->nconns);
+	    return NE_ERROR;
+	}
+	best = ne_calloc(sizeof *best);
+	best->next = sess->conns;
+	sess->conns = best;
+	sess->nconns++;
+    }
+
+    best->in_use = 1;
+    req->conn = best;
+    return NE_OK;
+}
+
+/* Return the connection of 'req', if any, to the pool. */
+static void conn_checkin(ne_request *req)
+{
+    if (req->conn == NULL)
+	return;
+    if (!req->conn_borrowed) {
+	req->conn->in_use = 0;
+	req->conn->last_used = ne_hrtime_now();
+    }
+    req->conn = NULL;
+    req->conn_borrowed = 0;
+}
+
+struct ne_conn *ne_request_conn(const ne_request *req)
+{
+    return req->conn;
+}
+
+/* Connect to all the addresses of 'host' at once; the winner becomes
+ * host->current. */
+static ne_socket *race_connect(ne_session *sess, struct host_info *host)
+{
+    const ne_inet_addr **addrs;
+    const ne_inet_addr *ia;
+    ne_socket *sock;
+    int count = 0, which = 0;
+
+    for (ia = ne_addr_first(host->address); ia; ia = ne_addr_next(host->address))
+	count++;
+    addrs = ne_malloc(count * sizeof *addrs);
+    count = 0;
+    for (ia = ne_addr_first(host->address); ia; ia = ne_addr_next(host->address))
+	addrs[count++] = ia;
+
+    notify_status(sess, ne_conn_connecting, host->hostport);
+    sock = ne_sock_connect_race(addrs, count, host->port,
+				sess->cotimeout ? sess->cotimeout : -1, &which);
+    if (sock)
+	host->current = addrs[which];
+    ne_free(addrs);
+    return sock;
+}
+
 /* Make new TCP connection to server at 'host' of type 'name'.  Note
  * that once a connection to a particular network address has
  * succeeded, that address will be used first for the next attempt to
- * connect. */
+ * connect, unless the session races them all. */
 /* TODO: an alternate implementation could always cycle through the
  * addresses: this could ease server load, but could hurt SSL session
  * caching for SSL sessions, which would increase server load. */
 static int do_connect(ne_request *req, struct host_info *host, const char *err)
 {
     ne_session *const sess = req->session;
+    struct ne_conn *const conn = req->conn;
 
-    if (host->current == NULL)
-	host->current = ne_addr_first(host->address);
+    req->timing.connect_start = ne_hrtime_now();
 
-    do {
-	notify_status(sess, ne_conn_connecting, host->hostport);
+    if (sess->race) {
+	conn->socket = race_connect(sess, host);
+    } else {
+	if (host->current == NULL)
+	    host->current = ne_addr_first(host->address);
+
+	do {
+	    notify_status(sess, ne_conn_connecting, host->hostport);
 #ifdef NE_DEBUGGING
-	if (ne_debug_mask & NE_DBG_HTTP) {
-	    char buf[150];
-	    NE_DEBUG(NE_DBG_HTTP, "Connecting to %s\n",
-		     ne_iaddr_print(host->current, buf, sizeof buf));
-	}
+	    if (ne_debug_mask & NE_DBG_HTTP) {
+		char buf[150];
+		NE_DEBUG(NE_DBG_HTTP, "Connecting to %s\n",
+			 ne_iaddr_print(host->current, buf, sizeof buf));
+	    }
 #endif
-	sess->socket = ne_sock_connect(host->current, host->port);
-    } while (sess->socket == NULL && /* try the next address... */
-	     (host->current = ne_addr_next(host->address)) != NULL);
+	    conn->socket = ne_sock_connect_ms(host->current, host->port,
+					      sess->cotimeout ? sess->cotimeout : -1);
+	} while (conn->socket == NULL && /* try the next address... */
+		 (host->current = ne_addr_next(host->address)) != NULL);
+    }
 
-    if (sess->socket == NULL) {
+    if (conn->socket == NULL) {
 	aborted(req, err, NE_SOCK_ERROR);
 	return NE_CONNECT;
     }
+    req->timing.connected = ne_hrtime_now();
 
     notify_status(sess, ne_conn_connected, sess->proxy.hostport);
     
     if (sess->rdtimeout)
-	ne_sock_read_timeout(sess->socket, sess->rdtimeout);
+	ne_sock_read_timeout_ms(conn->socket, sess->rdtimeout);
+    if (sess->rdbufmax)
+	ne_sock_read_buffer(conn->socket, sess->rdbufmax);
+    if (sess->nagle)
+	ne_sock_nodelay(conn->socket, 0);
 
     /* clear persistent connection flag. */
-    sess->persisted = 0;
+    conn->persisted = 0;
+    conn->serial++;
     return NE_OK;
 }
 
@@ -1373,8 +2014,11 @@ static int open_connection(ne_request *req)
 {
     ne_session *sess = req->session;
     int ret;
+
+    if (req->conn == NULL) 
+	HTTP_ERR(conn_checkout(req));
     
-    if (sess->connected) return NE_OK;
+    if (req->conn->connected) return NE_OK;
 
     if (!sess->use_proxy)
 	ret = do_connect(req, &sess->server, _("Could not connect to server"));
@@ -1384,14 +2028,14 @@ static int open_connection(ne_request *req)
 
     if (ret != NE_OK) return ret;
 
-    sess->connected = 1;
+    req->conn->connected = 1;
 
 #ifdef NEON_SSL
     /* Negotiate SSL layer if required. */
     if (sess->use_ssl && !sess->in_connect) {
         /* CONNECT tunnel */
         if (req->session->use_proxy)
-            ret = proxy_tunnel(sess);
+            ret = proxy_tunnel(req);
         
         if (ret == NE_OK)
             ret = ne_negotiate_ssl(req);
@@ -1399,7 +2043,7 @@ static int open_connection(ne_request *req)
         /* This is probably only really needed for ne_negotiate_ssl
          * failures as proxy_tunnel will fail via aborted(). */
         if (ret != NE_OK)
-            ne_close_connection(sess);
+            ne_close_conn(req->conn);
     }
 #endif
     
@@ -25,6 +25,7 @@
 #include "ne_utils.h" /* For ne_status */
 #include "ne_string.h" /* For sbuffer */
 #include "ne_session.h"
+#include "ne_socket.h" /* for ne_sock_stats */
 
 BEGIN_NEON_DECLS
 
@@ -87,6 +88,14 @@ typedef ssize_t (*ne_provide_body)(void *userdata,
 void ne_set_request_body_provider(ne_request *req, size_t size,
 				  ne_provide_body provider, void *userdata);
 
+/* As ne_set_request_body_provider, for a body whose size is not known
+ * in advance: it is sent with chunked transfer-encoding, one chunk for
+ * each block provided, and ends when the callback returns 0.  Only an
+ * HTTP/1.1 server will accept it. */
+void ne_set_request_body_provider_chunked(ne_request *req,
+					  ne_provide_body provider,
+					  void *userdata);
+
 /* Handling response bodies... you provide TWO callbacks:
  *
  * 1) 'acceptance' callback: determines whether you want to handle the
@@ -168,6 +177,33 @@ void ne_print_request_header(ne_request *req, const char *name,
 #endif /* __GNUC__ */
 ;
 
+/* A request template holds what is the same in each of a series of
+ * requests: the method, headers and body, serialized once.  Requests
+ * created from it differ only in the Request-URI, and any headers
+ * added to each. */
+typedef struct ne_request_template_s ne_request_template;
+
+/* Create a template for 'method' requests in session 'sess'.  It must
+ * be destroyed before the session is. */
+ne_request_template *ne_template_create(ne_session *sess, 
+					const char *method);
+
+/* Adds a header to the requests created from the template. */
+void ne_template_add_header(ne_request_template *tpl, const char *name,
+			    const char *value);
+
+/* Sets the body of the requests created from the template, along
+ * with its Content-Length; 'body' is copied. */
+void ne_template_set_body(ne_request_template *tpl, const char *body,
+			  size_t size);
+
+/* Create a request for 'path' from the template, as
+ * ne_request_create would.  The request shares the template's body,
+ * so the template must outlive it. */
+ne_request *ne_template_request(ne_request_template *tpl, const char *path);
+
+void ne_template_destroy(ne_request_template *tpl);
+
 /* ne_request_dispatch: Sends the given request, and reads the
  * response. Response-Status information can be retrieve with
  * ne_get_status(req).
@@ -182,6 +218,20 @@ void ne_print_request_header(ne_request *req, const char *name,
  */
 int ne_request_dispatch(ne_request *req);
 
+/* ne_pipeline_dispatch: Sends the 'count' requests 'reqs', all on the
+ * same session, down one persistent connection, with up to 'depth' of
+ * them written ahead of the response being read; the responses are
+ * then read in turn as by ne_request_dispatch.  Only idempotent
+ * methods (GET, HEAD, OPTIONS, TRACE, PROPFIND) are pipelined: given
+ * any other, or a depth below 2, the requests are dispatched one
+ * after another.  If the connection is lost with requests
+ * outstanding, they are sent again, no longer pipelined.
+ *
+ * Returns NE_OK if all the requests were dispatched okay, else the
+ * NE_* code of the first which failed; ne_get_status gives the
+ * outcome of each. */
+int ne_pipeline_dispatch(ne_request **reqs, int count, int depth);
+
 /* Returns a pointer to the response status information for the
  * given request. */
 const ne_status *ne_get_status(const ne_request *req)
@@ -197,6 +247,39 @@ const ne_status *ne_get_status(const ne_request *req)
 /* Returns pointer to session associated with request. */
 ne_session *ne_get_session(const ne_request *req);
 
+/* Timing information for a request, as ne_hrtime values.  Each is
+ * taken afresh every time the request is (re-)sent, and left as zero
+ * until the request gets that far. */
+typedef struct {
+    ne_hrtime send_start; /* about to send the request */
+    ne_hrtime connect_start; /* began connecting, if the request had to */
+    ne_hrtime connected; /* connection established */
+    ne_hrtime send_done; /* request, and any body, written */
+    ne_hrtime first_byte; /* status-line of the response read */
+    ne_hrtime headers_done; /* response headers read */
+    ne_hrtime body_done; /* response body read */
+} ne_request_timing;
+
+/* Returns the timing information for the given request. */
+const ne_request_timing *ne_get_request_timing(const ne_request *req);
+
+/* Returns the timing information of the last request on the session
+ * for which ne_end_request was reached, or all zeroes if there has
+ * been none yet.  Useful after the higher-level interfaces (ne_put,
+ * ne_lock, ...) which don't give the caller the request itself. */
+const ne_request_timing *ne_get_last_timing(ne_session *sess);
+
+/* Returns the system calls made on the connection for the given
+ * request, and the segments sent for it, from the start of sending it
+ * to the end of the response, as counted by ne_end_request.  With
+ * pipelining, the reads may include some of the responses which
+ * follow. */
+const ne_sock_stats *ne_get_request_syscalls(const ne_request *req);
+
+/* As ne_get_request_syscalls, for the last request on the session for
+ * which ne_end_request was reached. */
+const ne_sock_stats *ne_get_last_syscalls(ne_session *sess);
+
 /* Destroy memory associated with request pointer */
 void ne_request_destroy(ne_request *req);
 
@@ -225,6 +308,17 @@ int ne_end_request(ne_request *req);
  */
 ssize_t ne_read_response_block(ne_request *req, char *buffer, size_t buflen);
 
+/* Alternative to the ne_read_response_block loop: reads the rest of
+ * the response body, writing it to 'fd', or discarding it if 'fd' is
+ * -1, without passing it to the response body readers.  If the body is
+ * delimited by a Content-Length, it is handed to ne_sock_splice to
+ * move, which means no copy through user space on a plain socket.
+ * Returns NE_OK, or an NE_* error code with the session error set. */
+int ne_read_response_to_fd(ne_request *req, int fd);
+
+/* Returns the number of bytes of response body read so far. */
+off_t ne_get_response_length(const ne_request *req);
+
 /**** Request hooks handling *****/
 
 typedef void (*ne_free_hooks)(void *cookie);
@@ -270,6 +364,13 @@ void ne_hook_destroy_session(ne_session *sess,
 void ne_set_request_private(ne_request *req, const char *id, void *priv);
 void *ne_get_request_private(ne_request *req, const char *id);
 
+/* Allocate 'size' bytes of zeroed memory, or a copy of string 's',
+ * which lives as long as the request: it is freed along with the
+ * request by ne_request_destroy, and must not be freed otherwise.
+ * Cheaper than ne_malloc for the private state of hooks. */
+void *ne_request_alloc(ne_request *req, size_t size);
+char *ne_request_strdup(ne_request *req, const char *s);
+
 END_NEON_DECLS
 
 #endif /* NE_REQUEST_H */
@@ -104,8 +104,13 @@ void ne_session_destroy(ne_session *sess)
     NE_FREE(sess->scheme);
     NE_FREE(sess->user_agent);
 
-    if (sess->connected) {
-	ne_close_connection(sess);
+    ne_free_spare_requests(sess);
+
+    while (sess->conns) {
+	struct ne_conn *next = sess->conns->next;
+	ne_close_conn(sess->conns);
+	ne_free(sess->conns);
+	sess->conns = next;
     }
 
 #ifdef NEON_SSL
@@ -179,6 +184,8 @@ ne_session *ne_session_create(const char *scheme,
 
     /* Default expect-100 to OFF. */
     sess->expect100_works = -1;
+
+    sess->max_conns = 1;
     return sess;
 }
 
@@ -229,7 +236,52 @@ void ne_set_persist(ne_session *sess, int persist)
 
 void ne_set_read_timeout(ne_session *sess, int timeout)
 {
-    sess->rdtimeout = timeout;
+    sess->rdtimeout = timeout * 1000;
+}
+
+void ne_set_read_timeout_ms(ne_session *sess, int ms)
+{
+    sess->rdtimeout = ms;
+}
+
+void ne_set_connect_timeout_ms(ne_session *sess, int ms)
+{
+    sess->cotimeout = ms;
+}
+
+void ne_set_connect_race(ne_session *sess, int race)
+{
+    sess->race = race;
+}
+
+void ne_set_max_connections(ne_session *sess, int max)
+{
+    sess->max_conns = max;
+}
+
+void ne_set_idle_timeout(ne_session *sess, int timeout)
+{
+    sess->idle_timeout = timeout;
+}
+
+void ne_set_read_buffer(ne_session *sess, size_t max)
+{
+    sess->rdbufmax = max;
+}
+
+void ne_set_addr_flags(ne_session *sess, int flags)
+{
+    sess->addr_flags = flags;
+}
+
+void ne_set_nodelay(ne_session *sess, int nodelay)
+{
+    sess->nagle = !nodelay;
+}
+
+void ne_set_cork(ne_session *sess, int cork)
+{
+    sess->cork = cork;
 }
 
 #define AGENT " neon/" NEON_VERSION
@@ -263,17 +315,25 @@ const char *ne_get_error(ne_session *sess)
     return ne_strclean(sess->error);
 }
 
-void ne_close_connection(ne_session *sess)
+void ne_close_conn(struct ne_conn *conn)
 {
-    if (sess->connected) {
+    if (conn->connected) {
 	NE_DEBUG(NE_DBG_SOCKET, "Closing connection.\n");
-	ne_sock_close(sess->socket);
-	sess->socket = NULL;
+	ne_sock_close(conn->socket);
+	conn->socket = NULL;
 	NE_DEBUG(NE_DBG_SOCKET, "Connection closed.\n");
     } else {
 	NE_DEBUG(NE_DBG_SOCKET, "(Not closing closed connection!).\n");
     }
-    sess->connected = 0;
+    conn->connected = 0;
+}
+
+void ne_close_connection(ne_session *sess)
+{
+    struct ne_conn *conn;
+
+    for (conn = sess->conns; conn != NULL; conn = conn->next)
+	ne_close_conn(conn);
 }
 
 void ne_ssl_set_verify(ne_session *sess, ne_ssl_verify_fn fn, void *userdata)
@@ -650,12 +710,13 @@ static int provide_client_cert(SSL *ssl, X509 **cert, EVP_PKEY **pkey)
 int ne_negotiate_ssl(ne_request *req)
 {
     ne_session *sess = ne_get_session(req);
+    ne_socket *sock = ne_request_conn(req)->socket;
     SSL *ssl;
     X509 *cert;
 
     NE_DEBUG(NE_DBG_SSL, "Doing SSL negotiation.\n");
 
-    if (ne_sock_use_ssl_os(sess->socket, sess->ssl_context, 
+    if (ne_sock_use_ssl_os(sock, sess->ssl_context, 
 			   sess->ssl_sess, &ssl, sess)) {
 	if (sess->ssl_sess) {
 	    /* remove cached session. */
@@ -663,7 +724,7 @@ int ne_negotiate_ssl(ne_request *req)
 	    sess->ssl_sess = NULL;
 	}
 	ne_set_error(sess, _("SSL negotiation failed: %s"),
-		     ne_sock_error(sess->socket));
+		     ne_sock_error(sock));
 	return NE_ERROR;
     }	
     
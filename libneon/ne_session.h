@@ -44,8 +44,8 @@ ne_session *ne_session_create(const char *scheme,
 /* Finish an HTTP session */
 void ne_session_destroy(ne_session *sess);
 
-/* Prematurely force the connection to be closed for the given
- * session. */
+/* Prematurely force the connections of the given session to be
+ * closed. */
 void ne_close_connection(ne_session *sess);
 
 /* Set the proxy server to be used for the session. */
@@ -219,6 +219,51 @@ X509 *ne_ssl_server_cert(ne_session *req);
  * timeout value must be greater than zero. */
 void ne_set_read_timeout(ne_session *sess, int timeout);
 
+/* As ne_set_read_timeout, in milliseconds. */
+void ne_set_read_timeout_ms(ne_session *sess, int ms);
+
+/* Set the time (in milliseconds) allowed for establishing each
+ * connection to an address of the server; the default of zero means
+ * no limit beyond that of the kernel. */
+void ne_set_connect_timeout_ms(ne_session *sess, int ms);
+
+/* If 'race' is non-zero, connect to all the addresses the server's
+ * hostname resolved to at once, and use whichever connection is
+ * established first, rather than trying each in turn. */
+void ne_set_connect_race(ne_session *sess, int race);
+
+/* Set the most connections the session may have open to the server
+ * at once; each carries one request at a time.  The default is one,
+ * and more are only of use with the asynchronous interface
+ * (ne_async.h), which can have many requests outstanding on the one
+ * session. */
+void ne_set_max_connections(ne_session *sess, int max);
+
+/* Set the time (in seconds) after which an idle persistent connection
+ * is closed rather than reused.  The default of zero means no
+ * limit. */
+void ne_set_idle_timeout(ne_session *sess, int timeout);
+
+/* Let the read buffer of each connection grow up to 'max' bytes, as
+ * with ne_sock_read_buffer; the default is 4K. */
+void ne_set_read_buffer(ne_session *sess, size_t max);
+
+/* Set the NE_ADDR_* flags with which the hostnames of the server and
+ * proxy are resolved, e.g. NE_ADDR_IPV4 to connect over IPv4 only.
+ * Hostnames are resolved through the address cache: see
+ * ne_addr_resolve_cached. */
+void ne_set_addr_flags(ne_session *sess, int flags);
+
+/* Set TCP_NODELAY on each connection if 'nodelay' is non-zero, which
+ * is the default, so that small writes go out at once; if zero, they
+ * are left to Nagle's algorithm. */
+void ne_set_nodelay(ne_session *sess, int nodelay);
+
+/* Cork each connection (TCP_CORK, where the platform has it) while a
+ * request is being written, if 'cork' is non-zero, so that it goes
+ * out in full segments however many writes it takes. */
+void ne_set_cork(ne_session *sess, int cork);
+
 /* Sets the user-agent string. neon/VERSION will be appended, to make
  * the full header "User-Agent: product neon/VERSION".
  * If this function is not called, the User-Agent header is not sent.
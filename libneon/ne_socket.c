@@ -40,18 +40,37 @@
 #include <sys/time.h>
 #endif
 #include <sys/stat.h>
-#ifdef HAVE_SYS_SELECT_H
+#include <fcntl.h>
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#elif defined(HAVE_SYS_SELECT_H)
 #include <sys/select.h>
 #endif
 #ifdef HAVE_SYS_SOCKET_H
 #include <sys/socket.h>
 #endif
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
 
 #ifdef HAVE_NETINET_IN_H
 #include <netinet/in.h>
 #endif
 
+#ifdef HAVE_STRUCT_TCP_INFO_TCPI_DATA_SEGS_OUT
+/* the kernel's header, for the full struct tcp_info. */
+#include <linux/tcp.h>
+#else
 #include <netinet/tcp.h>
+#endif
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
 
 #ifdef HAVE_ARPA_INET_H
 #include <arpa/inet.h>
@@ -62,7 +81,18 @@
 
 #ifdef WIN32
 #include <winsock2.h>
+#endif
 #include <stddef.h>
+#include <time.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/* ne_sock_ring needs provided buffer rings and multishot receive,
+ * from Linux 6.0. */
+#if defined(HAVE_LINUX_IO_URING_H) && defined(IORING_RECV_MULTISHOT) \
+    && defined(__NR_io_uring_setup)
+#define NE_USE_URING
 #endif
 
 #if defined(NEON_SSL) && defined(HAVE_LIMITS_H)
@@ -146,10 +176,8 @@ typedef struct in_addr ne_inet_addr;
 #include <openssl/rand.h>
 #endif
 
-/* Socket read timeout */
-#define SOCKET_READ_TIMEOUT 120
-
-extern float g_thrput;
+/* Socket read timeout [ms] */
+#define SOCKET_READ_TIMEOUT (120 * 1000)
 
 /* Critical I/O functions on a socket: useful abstraction for easily
  * handling SSL I/O alongside raw socket I/O. */
@@ -160,30 +188,43 @@ struct iofns {
     /* Write exactly 'len' bytes from 'buf' to socket.  Return zero on
      * success, <0 on error. */
     ssize_t (*write)(ne_socket *s, const char *buf, size_t len);
-    /* Wait up to 'n' seconds for socket to become readable.  Returns
-     * 0 when readable, otherwise NE_SOCK_TIMEOUT or NE_SOCK_ERROR. */
-    int (*readable)(ne_socket *s, int n);
+    /* Write all 'count' blocks of 'vec' to socket, as write. */
+    ssize_t (*writev)(ne_socket *s, const struct ne_iovec *vec, int count);
+    /* Wait up to 'ms' milliseconds, or for ever if negative, for
+     * socket to become readable.  Returns 0 when readable, otherwise
+     * NE_SOCK_TIMEOUT or NE_SOCK_ERROR. */
+    int (*readable)(ne_socket *s, int ms);
 };
 
 struct ne_socket_s {
     int fd;
     char error[200];
     void *progress_ud;
-    int rdtimeout; /* read timeout. */
+    int rdtimeout; /* read timeout [ms]. */
     const struct iofns *ops;
 #ifdef NEON_SSL
     SSL *ssl;
     SSL_CTX *ssl_ctx;
 #endif
-    /* The read buffer: ->buffer stores byte which have been read; as
-     * these are consumed and passed back to the caller, bufpos
-     * advances through ->buffer.  ->bufavail gives the number of
-     * bytes which remain to be consumed in ->buffer (from ->bufpos),
-     * and is hence always <= RDBUFSIZ. */
+    /* The read buffer, a ring of ->bufsize bytes: the ->bufavail
+     * bytes which have been read but not yet consumed start at
+     * ->bufhead, and may wrap round from the end of ->buffer to its
+     * start, so that consuming data never moves what is left.  The
+     * buffer starts at RDBUFSIZ bytes, and doubles, up to ->bufmax,
+     * each time a read fills it completely. */
 #define RDBUFSIZ 4096
-    char buffer[RDBUFSIZ];
-    char *bufpos;
-    size_t bufavail;
+    char *buffer;
+    size_t bufsize, bufmax, bufhead, bufavail;
+    int bufgrow; /* the last read filled the whole buffer */
+    ne_sock_stats stats;
+    /* for ne_sock_splice: the pipe the data goes through, and
+     * /dev/null to discard it into; -1 until first needed. */
+    int pipe[2], nullfd;
+#ifdef NE_USE_URING
+    /* the ring driving the socket's I/O, if any, and its slot there. */
+    ne_sock_ring *ring;
+    unsigned int ringslot;
+#endif
 };
 
 /* ne_sock_addr represents an Internet address. */
@@ -195,6 +236,21 @@ struct ne_sock_addr_s {
     size_t cursor, count;
 #endif
     int errnum;
+    /* the entry of the address cache whose result this shares, or
+     * NULL if the result is this object's own. */
+    struct addr_entry *entry;
+};
+
+/* An entry of the address cache: the result of resolving 'hostname'
+ * with 'flags', which is shared by the objects returned from
+ * ne_addr_resolve_cached until it expires. */
+struct addr_entry {
+    char *hostname;
+    int flags;
+    time_t expires;
+    ne_sock_addr *addr;
+    int refs; /* objects sharing it, plus one whilst in the cache */
+    struct addr_entry *next;
 };
 
 /* set_error: set socket error string to 'str'. */
@@ -332,7 +388,7 @@ int ne_sock_block(ne_socket *sock, int n)
 {
     if (sock->bufavail)
 	return 0;
-    return sock->ops->readable(sock, n);
+    return sock->ops->readable(sock, n < 0 ? -1 : n * 1000);
 }
 
 /* Cast address object AD to type 'sockaddr_TY' */ 
@@ -341,38 +397,148 @@ int ne_sock_block(ne_socket *sock, int n)
 #define SOCK_ERR(x) do { ssize_t _sock_err = (x); \
 if (_sock_err < 0) return _sock_err; } while(0)
 
-ssize_t ne_sock_read(ne_socket *sock, char *buffer, size_t buflen)
+/* Byte 'n' of the buffered data. */
+#define BUF_AT(s, n) ((s)->buffer[((s)->bufhead + (n)) % (s)->bufsize])
+
+/* Returns the free space in the read buffer which follows on from the
+ * buffered data without wrapping, setting *tail to its start.  If the
+ * buffer is empty, it is first grown if due. */
+static size_t buf_space(ne_socket *sock, char **tail)
 {
-    ssize_t bytes;
+    size_t end;
+
+    if (sock->bufavail == 0) {
+	sock->bufhead = 0;
+	if (sock->bufgrow && sock->bufsize < sock->bufmax) {
+	    sock->bufsize *= 2;
+	    if (sock->bufsize > sock->bufmax)
+		sock->bufsize = sock->bufmax;
+	    ne_free(sock->buffer);
+	    sock->buffer = ne_malloc(sock->bufsize);
+	    NE_DEBUG(NE_DBG_SOCKET, "Read buffer grown to %" NE_FMT_SIZE_T
+		     " bytes.\n", sock->bufsize);
+	}
+	sock->bufgrow = 0;
+    }
+
+    end = (sock->bufhead + sock->bufavail) % sock->bufsize;
+    *tail = sock->buffer + end;
+    if (sock->bufavail == sock->bufsize)
+	return 0;
+    return end >= sock->bufhead ? sock->bufsize - end : sock->bufhead - end;
+}
+
+/* Read once from the socket onto the end of the buffered data, which
+ * must not fill the buffer.  Returns the number of bytes read, or
+ * NE_SOCK_* on error. */
+static ssize_t buf_fill(ne_socket *sock)
+{
+    char *tail;
+    size_t space = buf_space(sock, &tail);
+    ssize_t ret;
+
+    ret = sock->ops->read(sock, tail, space);
+    if (ret > 0) {
+	sock->bufavail += ret;
+	sock->bufgrow = sock->bufavail == sock->bufsize;
+    }
+    return ret;
+}
+
+/* Copy up to 'len' bytes of buffered data to 'buffer', consuming them
+ * if 'consume' is non-zero.  Returns the number of bytes copied. */
+static size_t buf_take(ne_socket *sock, char *buffer, size_t len, 
+		       int consume)
+{
+    size_t first = sock->bufsize - sock->bufhead;
+
+    if (len > sock->bufavail)
+	len = sock->bufavail;
+    if (first > len)
+	first = len;
+    memcpy(buffer, sock->buffer + sock->bufhead, first);
+    memcpy(buffer + first, sock->buffer, len - first);
+
+    if (consume) {
+	sock->bufhead = (sock->bufhead + len) % sock->bufsize;
+	sock->bufavail -= len;
+    }
+    return len;
+}
+
+#ifdef NE_USE_URING
+/* Append 'len' bytes of 'data' to the buffered data, growing the
+ * buffer if need be. */
+static void buf_append(ne_socket *sock, const char *data, size_t len)
+{
+    size_t space;
+    char *tail;
+
+    if (sock->bufsize - sock->bufavail < len) {
+	size_t size = sock->bufsize;
+	char *buf;
+
+	while (size - sock->bufavail < len)
+	    size *= 2;
+	buf = ne_malloc(size);
+	buf_take(sock, buf, sock->bufavail, 0);
+	ne_free(sock->buffer);
+	sock->buffer = buf;
+	sock->bufsize = size;
+	sock->bufhead = 0;
+    }
 
-#if 0
-    NE_DEBUG(NE_DBG_SOCKET, "buf: at %d, %d avail [%s]\n", 
-	     sock->bufpos - sock->buffer, sock->bufavail, sock->bufpos);
+    while (len > 0) {
+	space = buf_space(sock, &tail);
+	if (space > len)
+	    space = len;
+	memcpy(tail, data, space);
+	sock->bufavail += space;
+	data += space;
+	len -= space;
+    }
+}
 #endif
 
+/* Returns the offset just past the first 'ch' in the buffered data,
+ * looking from offset 'from' on, or 0 if there is none. */
+static size_t buf_find(const ne_socket *sock, int ch, size_t from)
+{
+    size_t first = sock->bufsize - sock->bufhead;
+    const char *p;
+
+    if (first > sock->bufavail)
+	first = sock->bufavail;
+    if (from < first) {
+	p = memchr(sock->buffer + sock->bufhead + from, ch, first - from);
+	if (p)
+	    return p - (sock->buffer + sock->bufhead) + 1;
+	from = first;
+    }
+    if (from < sock->bufavail) {
+	p = memchr(sock->buffer + (from - first), ch, sock->bufavail - from);
+	if (p)
+	    return first + (p - sock->buffer) + 1;
+    }
+    return 0;
+}
+
+ssize_t ne_sock_read(ne_socket *sock, char *buffer, size_t buflen)
+{
+    ssize_t bytes;
+
     if (sock->bufavail > 0) {
 	/* Deliver buffered data. */
-	if (buflen > sock->bufavail)
-	    buflen = sock->bufavail;
-	memcpy(buffer, sock->bufpos, buflen);
-	sock->bufpos += buflen;
-	sock->bufavail -= buflen;
-	return buflen;
-    } else if (buflen >= sizeof sock->buffer) {
+	return buf_take(sock, buffer, buflen, 1);
+    } else if (buflen >= sock->bufsize) {
 	/* No need for read buffer. */
 	return sock->ops->read(sock, buffer, buflen);
     } else {
 	/* Fill read buffer. */
-	bytes = sock->ops->read(sock, sock->buffer, sizeof sock->buffer);
+	bytes = buf_fill(sock);
 	if (bytes <= 0)
 	    return bytes;
-
-	if (buflen > (size_t)bytes)
-	    buflen = bytes;
-	memcpy(buffer, sock->buffer, buflen);
-	sock->bufpos = sock->buffer + buflen;
-	sock->bufavail = bytes - buflen;
-	return buflen; 
+	return buf_take(sock, buffer, buflen, 1);
     }
 }
 
@@ -380,44 +546,55 @@ ssize_t ne_sock_peek(ne_socket *sock, char *buffer, size_t buflen)
 {
     ssize_t bytes;
     
-    if (sock->bufavail) {
-	/* just return buffered data. */
-	bytes = sock->bufavail;
-    } else {
+    if (sock->bufavail == 0) {
 	/* fill the buffer. */
-	bytes = sock->ops->read(sock, sock->buffer, sizeof sock->buffer);
+	bytes = buf_fill(sock);
 	if (bytes <= 0)
 	    return bytes;
-
-	sock->bufpos = sock->buffer;
-	sock->bufavail = bytes;
     }
 
-    if (buflen > (size_t)bytes)
-	buflen = bytes;
-
-    memcpy(buffer, sock->bufpos, buflen);
-
-    return buflen;
+    return buf_take(sock, buffer, buflen, 0);
 }
 
-/* Await data on raw fd in socket. */
-static int readable_raw(ne_socket *sock, int secs)
+/* Await data on raw fd in socket.  poll() is used where there is
+ * one, since select() cannot cope with descriptors from FD_SETSIZE
+ * up, and costs more the more there are. */
+static int readable_raw(ne_socket *sock, int ms)
 {
-    int fdno = sock->fd, ret;
+    int ret;
+#ifdef HAVE_POLL_H
+    struct pollfd pfd;
+
+    pfd.fd = sock->fd;
+    pfd.events = POLLIN;
+    do {
+	sock->stats.waits++;
+	ret = poll(&pfd, 1, ms);
+    } while (ret < 0 && NE_ISINTR(ne_errno));
+#else
+    int fdno = sock->fd;
     fd_set rdfds;
-    struct timeval timeout, *tvp = (secs >= 0 ? &timeout : NULL);
+    struct timeval timeout, *tvp = (ms >= 0 ? &timeout : NULL);
+
+#ifndef WIN32
+    if (fdno >= FD_SETSIZE) {
+	set_error(sock, _("Socket descriptor too large for select()"));
+	return NE_SOCK_ERROR;
+    }
+#endif
 
     /* Init the fd set */
     FD_ZERO(&rdfds);
     do {
 	FD_SET(fdno, &rdfds);
 	if (tvp) {
-	    tvp->tv_sec = secs;
-	    tvp->tv_usec = 0;
+	    tvp->tv_sec = ms / 1000;
+	    tvp->tv_usec = (ms % 1000) * 1000;
 	}
+	sock->stats.waits++;
 	ret = select(fdno + 1, &rdfds, NULL, NULL, tvp);
     } while (ret < 0 && NE_ISINTR(ne_errno));
+#endif
     if (ret < 0) {
 	set_strerror(sock, ne_errno);
 	return NE_SOCK_ERROR;
@@ -433,6 +610,7 @@ static ssize_t read_raw(ne_socket *sock, char *buffer, size_t len)
     if (ret) return ret;
 
     do {
+	sock->stats.reads++;
 	ret = ne_read(sock->fd, buffer, len);
     } while (ret == -1 && NE_ISINTR(ne_errno));
 
@@ -456,6 +634,7 @@ static ssize_t write_raw(ne_socket *sock, const char *data, size_t length)
     ssize_t wrote;
     
     do {
+	sock->stats.writes++;
 	wrote = ne_write(sock->fd, data, length);
         if (wrote > 0) {
             data += wrote;
@@ -472,11 +651,76 @@ static ssize_t write_raw(ne_socket *sock, const char *data, size_t length)
     return 0;
 }
 
-static const struct iofns iofns_raw = { read_raw, write_raw, readable_raw };
+#if !defined(HAVE_SYS_UIO_H) || defined(NEON_SSL) || defined(NE_USE_URING)
+/* Write the blocks one at a time. */
+static ssize_t writev_each(ne_socket *sock, const struct ne_iovec *vec, 
+			   int count)
+{
+    ssize_t ret = 0;
+    int n;
+
+    for (n = 0; n < count && ret == 0; n++)
+	ret = sock->ops->write(sock, vec[n].base, vec[n].len);
+
+    return ret;
+}
+#endif
+
+#ifdef HAVE_SYS_UIO_H
+/* The most blocks passed to one writev() call. */
+#define NE_IOV_MAX 16
+
+static ssize_t writev_raw(ne_socket *sock, const struct ne_iovec *vec, 
+			  int count)
+{
+    struct iovec iov[NE_IOV_MAX];
+    ssize_t wrote;
+    int n, first = 0;
+
+    while (first < count) {
+	for (n = 0; n < NE_IOV_MAX && first + n < count; n++) {
+	    iov[n].iov_base = (void *)vec[first + n].base;
+	    iov[n].iov_len = vec[first + n].len;
+	}
+
+	while (n > 0) {
+	    sock->stats.writes++;
+	    wrote = writev(sock->fd, iov, n);
+	    if (wrote < 0) {
+		int errnum = ne_errno;
+		if (NE_ISINTR(errnum))
+		    continue;
+		set_strerror(sock, errnum);
+		return MAP_ERR(errnum);
+	    }
+	    /* skip what was written, which may end part way through
+	     * a block. */
+	    while (n > 0 && (size_t)wrote >= iov[0].iov_len) {
+		wrote -= iov[0].iov_len;
+		memmove(iov, iov + 1, --n * sizeof *iov);
+		first++;
+	    }
+	    if (n > 0) {
+		iov[0].iov_base = (char *)iov[0].iov_base + wrote;
+		iov[0].iov_len -= wrote;
+	    }
+	}
+    }
+
+    return 0;
+}
+#else
+/* without writev(), the blocks go one write at a time. */
+#define writev_raw writev_each
+#endif
+
+static const struct iofns iofns_raw = { 
+    read_raw, write_raw, writev_raw, readable_raw 
+};
 
 #ifdef NEON_SSL
 /* OpenSSL I/O function implementations. */
-static int readable_ossl(ne_socket *sock, int secs)
+static int readable_ossl(ne_socket *sock, int ms)
 {
     /* If there is buffered SSL data, then don't block on the socket.
      * FIXME: make sure that SSL_read *really* won't block if
@@ -486,7 +730,7 @@ static int readable_ossl(ne_socket *sock, int secs)
     if (sock->ssl && SSL_pending(sock->ssl))
 	return 0;
 
-    return readable_raw(sock, secs);
+    return readable_raw(sock, ms);
 }
 
 /* SSL error handling, according to SSL_get_error(3). */
@@ -536,6 +780,7 @@ static ssize_t read_ossl(ne_socket *sock, char *buffer, size_t len)
     ret = readable_ossl(sock, sock->rdtimeout);
     if (ret) return ret;
     
+    sock->stats.reads++;
     ret = SSL_read(sock->ssl, buffer, CAST2INT(len));
     if (ret <= 0)
 	ret = error_ossl(sock, ret);
@@ -546,6 +791,7 @@ static ssize_t read_ossl(ne_socket *sock, char *buffer, size_t len)
 static ssize_t write_ossl(ne_socket *sock, const char *data, size_t len)
 {
     int ret, ilen = CAST2INT(len);
+    sock->stats.writes++;
     ret = SSL_write(sock->ssl, data, ilen);
     /* ssl.h says SSL_MODE_ENABLE_PARTIAL_WRITE must be enabled to
      * have SSL_write return < length...  so, SSL_write should never
@@ -558,57 +804,1022 @@ static ssize_t write_ossl(ne_socket *sock, const char *data, size_t len)
 static const struct iofns iofns_ossl = {
     read_ossl,
     write_ossl,
+    writev_each,
     readable_ossl
 };
 
 #endif /* NEON_SSL */
 
+#ifdef NE_USE_URING
+/* io_uring I/O function implementations, for sockets driven through
+ * an ne_sock_ring.  Data is received by a multishot receive on each
+ * socket into the RING_RBUFS buffers provided to the kernel, and
+ * queued for the socket in the order it arrived until read.  Writes
+ * are copied into the RING_WBUFS buffers registered with the kernel,
+ * and queued for the socket, one write in flight at a time so that
+ * they go out in order.  Nothing is submitted until the ring is next
+ * waited on, so the writes of many sockets go in one system call, and
+ * the writes to one socket meanwhile are gathered into one buffer. */
+#define RING_RBUFS 256 /* a power of two */
+#define RING_RBUFSIZ 4096
+#define RING_WBUFS 256
+#define RING_WBUFSIZ 8192
+#define RING_BGID 0 /* the buffer group of the receive buffers */
+
+/* What an operation is, and whose, in its user_data: the generation
+ * of the slot when queued, the slot (or for a write, the send buffer,
+ * which knows its slot), and the kind of operation. */
+enum { RING_RECV, RING_SEND, RING_CANCEL };
+#define RING_UD(gen, idx, kind) \
+    (((__u64)(gen) << 32) | ((__u64)(idx) << 2) | (kind))
+
+/* A socket using the ring. */
+struct ring_slot {
+    ne_socket *sock; /* NULL whilst the slot is free */
+    unsigned int gen; /* bumped each time the slot is freed */
+    void *userdata;
+    /* the receive buffers holding data not yet read, linked through
+     * ->rnext of the ring; ->roff bytes of the first have been read. */
+    int rhead, rtail;
+    size_t roff;
+    /* the send buffers queued, linked through ->wnext of the ring;
+     * ->woff bytes of the first have been written. */
+    int whead, wtail;
+    size_t woff;
+    int error; /* NE_SOCK_* once the connection has failed or closed */
+    unsigned int armed:1; /* the multishot receive is in place */
+    unsigned int sending:1; /* the first send buffer is in flight */
+    unsigned int wpend:1; /* on the list of those with writes to send */
+    unsigned int ready:1; /* on the ready list */
+    int nextfree;
+};
+
+struct ne_sock_ring_s {
+    int fd;
+    /* the submission queue */
+    unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array, sq_entries;
+    struct io_uring_sqe *sqes;
+    unsigned int queued; /* entries queued but not yet submitted */
+    /* the completion queue */
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_map, *cq_map;
+    size_t sq_maplen, cq_maplen, sqes_len;
+    /* the receive buffers, and the ring through which they are given
+     * to the kernel. */
+    struct io_uring_buf_ring *rbr;
+    unsigned short rbr_tail;
+    char *rbufs;
+    int rnext[RING_RBUFS];
+    size_t rlen[RING_RBUFS];
+    /* the send buffers, and whether they are registered. */
+    char *wbufs;
+    int fixed;
+    int wnext[RING_WBUFS], wfree;
+    size_t wlen[RING_WBUFS];
+    unsigned int wslot[RING_WBUFS];
+    /* the sockets using the ring; the slots with data newly arrived
+     * are listed in ->ready, and moved to ->running to be handed to
+     * the callback of ne_sock_ring_run. */
+    struct ring_slot *slots;
+    unsigned int nslots, *ready, nready, *running;
+    unsigned int *wpending, nwpending;
+    int slotfree;
+};
+
+static const struct iofns iofns_ring;
+
+/* Submit 'submit' queued entries, then wait for at least 'wait'
+ * completions, for up to 'ms' milliseconds if not negative.  Returns
+ * the number submitted, or -errno. */
+static int ring_enter(ne_sock_ring *ring, unsigned int submit,
+		      unsigned int wait, int ms)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned int flags = 0;
+    int ret;
+
+    memset(&arg, 0, sizeof arg);
+    if (wait) {
+	flags |= IORING_ENTER_GETEVENTS;
+	if (ms >= 0) {
+	    ts.tv_sec = ms / 1000;
+	    ts.tv_nsec = (ms % 1000) * 1000000L;
+	    arg.ts = (__u64)(unsigned long)&ts;
+	}
+    }
+    flags |= IORING_ENTER_EXT_ARG;
+    ret = syscall(__NR_io_uring_enter, ring->fd, submit, wait, flags,
+		  &arg, sizeof arg);
+    if (ret < 0)
+	return -errno;
+    ring->queued -= ret;
+    return ret;
+}
+
+/* Returns an entry to fill in at the tail of the submission queue,
+ * which is submitted with the next ring_enter; or NULL on error.
+ * Without SQPOLL the kernel only looks at the queue from within
+ * io_uring_enter, so the tail may be moved on before the entry is
+ * filled. */
+static struct io_uring_sqe *ring_sqe(ne_sock_ring *ring)
+{
+    unsigned int tail = *ring->sq_tail, idx;
+    struct io_uring_sqe *sqe;
+
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE)
+	>= ring->sq_entries) {
+	/* the queue is full: hand it over. */
+	if (ring_enter(ring, ring->queued, 0, 0) < 0
+	    || tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE)
+	    >= ring->sq_entries)
+	    return NULL;
+    }
+
+    idx = tail & *ring->sq_mask;
+    sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof *sqe);
+    ring->sq_array[idx] = idx;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->queued++;
+    return sqe;
+}
+
+/* Give receive buffer 'b' back to the kernel. */
+static void ring_recycle(ne_sock_ring *ring, int b)
+{
+    struct io_uring_buf *buf;
+
+    buf = &ring->rbr->bufs[ring->rbr_tail & (RING_RBUFS - 1)];
+    buf->addr = (__u64)(unsigned long)(ring->rbufs + b * RING_RBUFSIZ);
+    buf->len = RING_RBUFSIZ;
+    buf->bid = b;
+    ring->rbr_tail++;
+    __atomic_store_n(&ring->rbr->tail, ring->rbr_tail, __ATOMIC_RELEASE);
+}
+
+static void ring_wfree(ne_sock_ring *ring, int b)
+{
+    ring->wnext[b] = ring->wfree;
+    ring->wfree = b;
+}
+
+/* Returns the slot 'idx' if it still belongs to the socket for which
+ * an operation was queued in generation 'gen', else NULL. */
+static struct ring_slot *ring_live(ne_sock_ring *ring, unsigned int idx,
+				   unsigned int gen)
+{
+    struct ring_slot *s;
+
+    if (idx >= ring->nslots)
+	return NULL;
+    s = &ring->slots[idx];
+    return s->sock != NULL && s->gen == gen ? s : NULL;
+}
+
+static void ring_mark_ready(ne_sock_ring *ring, unsigned int idx)
+{
+    if (!ring->slots[idx].ready) {
+	ring->slots[idx].ready = 1;
+	ring->ready[ring->nready++] = idx;
+    }
+}
+
+/* Queue the multishot receive for slot 'idx'. */
+static int ring_arm(ne_sock_ring *ring, unsigned int idx)
+{
+    struct ring_slot *s = &ring->slots[idx];
+    struct io_uring_sqe *sqe = ring_sqe(ring);
+
+    if (sqe == NULL)
+	return -1;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = s->sock->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RING_BGID;
+    sqe->user_data = RING_UD(s->gen, idx, RING_RECV);
+    s->armed = 1;
+    return 0;
+}
+
+/* Queue the write of the rest of the first send buffer of slot
+ * 'idx'. */
+static int ring_send(ne_sock_ring *ring, unsigned int idx)
+{
+    struct ring_slot *s = &ring->slots[idx];
+    struct io_uring_sqe *sqe = ring_sqe(ring);
+    int b = s->whead;
+
+    if (sqe == NULL)
+	return -1;
+    sqe->opcode = ring->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = s->sock->fd;
+    sqe->off = (__u64)-1;
+    sqe->addr = (__u64)(unsigned long)(ring->wbufs + b * RING_WBUFSIZ
+				       + s->woff);
+    sqe->len = ring->wlen[b] - s->woff;
+    sqe->user_data = RING_UD(s->gen, b, RING_SEND);
+    s->sending = 1;
+    return 0;
+}
+
+/* Fail the socket of slot 's' with error 'errnum'. */
+static void ring_fail(struct ring_slot *s, int errnum)
+{
+    set_strerror(s->sock, errnum);
+    s->error = MAP_ERR(errnum);
+}
+
+/* Handle the completion of an operation. */
+static void ring_complete(ne_sock_ring *ring, const struct io_uring_cqe *cqe)
+{
+    unsigned int kind = cqe->user_data & 3, gen = cqe->user_data >> 32;
+    unsigned int idx = (cqe->user_data >> 2) & 0x3fffffff;
+    struct ring_slot *s;
+    int b;
+
+    switch (kind) {
+    case RING_RECV:
+	s = ring_live(ring, idx, gen);
+	if (cqe->flags & IORING_CQE_F_BUFFER) {
+	    b = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+	    if (s && cqe->res > 0) {
+		ring->rlen[b] = cqe->res;
+		ring->rnext[b] = -1;
+		if (s->rtail >= 0)
+		    ring->rnext[s->rtail] = b;
+		else
+		    s->rhead = b;
+		s->rtail = b;
+	    } else {
+		ring_recycle(ring, b);
+	    }
+	}
+	if (s == NULL)
+	    break;
+	if (!(cqe->flags & IORING_CQE_F_MORE))
+	    s->armed = 0;
+	if (cqe->res == 0) {
+	    set_error(s->sock, _("Connection closed"));
+	    s->error = NE_SOCK_CLOSED;
+	} else if (cqe->res == -ENOBUFS || cqe->res == -ECANCELED) {
+	    /* the receive is put back when the socket is next read, so
+	     * have it read even with nothing queued: else, once every
+	     * buffer is taken, it would never be armed again. */
+	} else if (cqe->res < 0) {
+	    ring_fail(s, -cqe->res);
+	}
+	ring_mark_ready(ring, idx);
+	break;
+    case RING_SEND:
+	b = idx;
+	idx = ring->wslot[b];
+	s = ring_live(ring, idx, gen);
+	if (s == NULL) {
+	    ring_wfree(ring, b);
+	    break;
+	}
+	s->sending = 0;
+	if (cqe->res <= 0) {
+	    ring_fail(s, cqe->res < 0 ? -cqe->res : EPIPE);
+	    /* nothing more will go out. */
+	    while ((b = s->whead) >= 0) {
+		s->whead = ring->wnext[b];
+		ring_wfree(ring, b);
+	    }
+	    s->wtail = -1;
+	    ring_mark_ready(ring, idx);
+	    break;
+	}
+	s->woff += cqe->res;
+	if (s->woff == ring->wlen[b]) {
+	    s->woff = 0;
+	    s->whead = ring->wnext[b];
+	    if (s->whead < 0)
+		s->wtail = -1;
+	    ring_wfree(ring, b);
+	}
+	if (s->whead >= 0 && ring_send(ring, idx))
+	    ring_fail(s, EAGAIN);
+	break;
+    }
+}
+
+/* Submit what is queued, wait for at least one completion for up to
+ * 'ms' milliseconds, and handle all that have arrived.  Returns
+ * non-zero on error, with errno set. */
+static int ring_wait(ne_sock_ring *ring, int ms)
+{
+    unsigned int head, tail, n;
+    struct ring_slot *s;
+    int ret;
+
+    /* queue the first write of each socket written to since. */
+    for (n = 0; n < ring->nwpending; n++) {
+	s = &ring->slots[ring->wpending[n]];
+	s->wpend = 0;
+	if (s->sock && s->whead >= 0 && !s->sending && !s->error
+	    && ring_send(ring, ring->wpending[n]))
+	    ring_fail(s, EAGAIN);
+    }
+    ring->nwpending = 0;
+
+    ret = ring_enter(ring, ring->queued, 1, ms);
+    if (ret < 0 && ret != -ETIME && ret != -EINTR) {
+	errno = -ret;
+	return -1;
+    }
+
+    head = *ring->cq_head;
+    tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++)
+	ring_complete(ring, &ring->cqes[head & *ring->cq_mask]);
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* Copy up to 'len' bytes of the data received for 'sock' to
+ * 'buffer'.  Returns the number of bytes copied; or if there are none,
+ * the socket's error if any, else 0. */
+static ssize_t ring_take(ne_socket *sock, char *buffer, size_t len)
+{
+    ne_sock_ring *ring = sock->ring;
+    struct ring_slot *s = &ring->slots[sock->ringslot];
+    size_t got = 0, n;
+    int b;
+
+    while (got < len && (b = s->rhead) >= 0) {
+	n = ring->rlen[b] - s->roff;
+	if (n > len - got)
+	    n = len - got;
+	memcpy(buffer + got, ring->rbufs + b * RING_RBUFSIZ + s->roff, n);
+	got += n;
+	s->roff += n;
+	if (s->roff == ring->rlen[b]) {
+	    s->rhead = ring->rnext[b];
+	    if (s->rhead < 0)
+		s->rtail = -1;
+	    s->roff = 0;
+	    ring_recycle(ring, b);
+	}
+    }
+
+    if (got > 0)
+	return got;
+    if (s->error)
+	return s->error;
+    if (!s->armed && ring_arm(ring, sock->ringslot)) {
+	set_error(sock, _("Could not queue receive"));
+	return NE_SOCK_ERROR;
+    }
+    return 0;
+}
+
+static int readable_ring(ne_socket *sock, int ms)
+{
+    ne_sock_ring *ring = sock->ring;
+    ne_hrtime end = ne_hrtime_now() + (ne_hrtime)ms * 1000000;
+    struct ring_slot *s;
+    int wait = ms;
+
+    for (;;) {
+	/* the slots may move as others are added. */
+	s = &ring->slots[sock->ringslot];
+	if (s->rhead >= 0 || s->error)
+	    return 0;
+	if (!s->armed && ring_arm(ring, sock->ringslot)) {
+	    set_error(sock, _("Could not queue receive"));
+	    return NE_SOCK_ERROR;
+	}
+	if (ms >= 0) {
+	    ne_hrtime now = ne_hrtime_now();
+	    if (now >= end)
+		return NE_SOCK_TIMEOUT;
+	    wait = (end - now + 999999) / 1000000;
+	}
+	sock->stats.waits++;
+	if (ring_wait(ring, wait)) {
+	    set_strerror(sock, errno);
+	    return NE_SOCK_ERROR;
+	}
+    }
+}
+
+static ssize_t read_ring(ne_socket *sock, char *buffer, size_t len)
+{
+    ssize_t ret;
+
+    ret = readable_ring(sock, sock->rdtimeout);
+    if (ret) return ret;
+    return ring_take(sock, buffer, len);
+}
+
+static ssize_t write_ring(ne_socket *sock, const char *data, size_t len)
+{
+    ne_sock_ring *ring = sock->ring;
+    struct ring_slot *s;
+    size_t n;
+    int b;
+
+    while (len > 0) {
+	s = &ring->slots[sock->ringslot];
+	if (s->error)
+	    return s->error;
+
+	b = s->wtail;
+	if (b >= 0 && !(b == s->whead && s->sending)
+	    && ring->wlen[b] < RING_WBUFSIZ) {
+	    /* add to the last buffer queued, not yet in flight. */
+	    n = RING_WBUFSIZ - ring->wlen[b];
+	} else if ((b = ring->wfree) >= 0) {
+	    ring->wfree = ring->wnext[b];
+	    ring->wlen[b] = 0;
+	    ring->wnext[b] = -1;
+	    ring->wslot[b] = sock->ringslot;
+	    if (s->wtail >= 0)
+		ring->wnext[s->wtail] = b;
+	    else
+		s->whead = b;
+	    s->wtail = b;
+	    n = RING_WBUFSIZ;
+	} else {
+	    /* every buffer is in use: wait for some to go out. */
+	    if (ring_wait(ring, -1)) {
+		set_strerror(sock, errno);
+		return NE_SOCK_ERROR;
+	    }
+	    continue;
+	}
+
+	if (n > len)
+	    n = len;
+	memcpy(ring->wbufs + b * RING_WBUFSIZ + ring->wlen[b], data, n);
+	ring->wlen[b] += n;
+	data += n;
+	len -= n;
+
+	if (!s->sending && !s->wpend) {
+	    s->wpend = 1;
+	    ring->wpending[ring->nwpending++] = sock->ringslot;
+	}
+    }
+
+    return 0;
+}
+
+static const struct iofns iofns_ring = {
+    read_ring,
+    write_ring,
+    writev_each,
+    readable_ring
+};
+
+/* Take 'sock' off its ring, making it a plain socket again.  If
+ * 'keep' is non-zero, the writes queued go out first, and the data
+ * received but not read is kept in the read buffer; else they are
+ * dropped, as the socket is being closed. */
+static void ring_detach(ne_socket *sock, int keep)
+{
+    ne_sock_ring *ring = sock->ring;
+    unsigned int idx = sock->ringslot;
+    struct io_uring_sqe *sqe;
+    struct ring_slot *s;
+    int b;
+
+    while (keep && ring->slots[idx].whead >= 0 && !ring->slots[idx].error)
+	if (ring_wait(ring, -1))
+	    break;
+
+    if (ring->slots[idx].armed && (sqe = ring_sqe(ring)) != NULL) {
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->addr = RING_UD(ring->slots[idx].gen, idx, RING_RECV);
+	sqe->user_data = RING_UD(0, 0, RING_CANCEL);
+	ring_enter(ring, ring->queued, 0, 0);
+	/* the receive may yet bring data with it as it ends. */
+	while (keep && ring->slots[idx].armed)
+	    if (ring_wait(ring, -1))
+		break;
+    }
+
+    s = &ring->slots[idx];
+    while ((b = s->rhead) >= 0) {
+	if (keep)
+	    buf_append(sock, ring->rbufs + b * RING_RBUFSIZ + s->roff,
+		       ring->rlen[b] - s->roff);
+	s->rhead = ring->rnext[b];
+	s->roff = 0;
+	ring_recycle(ring, b);
+    }
+
+    /* the buffer in flight is freed once its write completes. */
+    b = s->whead;
+    if (b >= 0 && s->sending)
+	b = ring->wnext[b];
+    while (b >= 0) {
+	int next = ring->wnext[b];
+	ring_wfree(ring, b);
+	b = next;
+    }
+
+    s->sock = NULL;
+    s->userdata = NULL;
+    s->gen++;
+    s->nextfree = ring->slotfree;
+    ring->slotfree = idx;
+    sock->ring = NULL;
+    sock->ops = &iofns_raw;
+}
+
+/* Release what ne_sock_ring_create has set up of 'ring'. */
+static void ring_free(ne_sock_ring *ring)
+{
+    if (ring->fd >= 0)
+	close(ring->fd);
+    if (ring->sqes)
+	munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_map && ring->cq_map != ring->sq_map)
+	munmap(ring->cq_map, ring->cq_maplen);
+    if (ring->sq_map)
+	munmap(ring->sq_map, ring->sq_maplen);
+    if (ring->rbr)
+	munmap(ring->rbr, RING_RBUFS * sizeof(struct io_uring_buf));
+    if (ring->rbufs) ne_free(ring->rbufs);
+    if (ring->wbufs) ne_free(ring->wbufs);
+    if (ring->slots) ne_free(ring->slots);
+    if (ring->ready) ne_free(ring->ready);
+    if (ring->running) ne_free(ring->running);
+    if (ring->wpending) ne_free(ring->wpending);
+    ne_free(ring);
+}
+
+ne_sock_ring *ne_sock_ring_create(unsigned int entries)
+{
+    struct io_uring_params p;
+    struct io_uring_buf_reg reg;
+    struct iovec iov;
+    ne_sock_ring *ring;
+    char *sq, *cq;
+    int n;
+
+    if (entries < 64)
+	entries = 64;
+    memset(&p, 0, sizeof p);
+    /* each receive may complete many times over. */
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entries * 4;
+
+    ring = ne_calloc(sizeof *ring);
+    ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd < 0 || !(p.features & IORING_FEAT_EXT_ARG)) {
+	NE_DEBUG(NE_DBG_SOCKET, "io_uring not available.\n");
+	goto fail;
+    }
+
+    ring->sq_maplen = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    ring->cq_maplen = p.cq_off.cqes
+	+ p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+	if (ring->cq_maplen > ring->sq_maplen)
+	    ring->sq_maplen = ring->cq_maplen;
+	ring->cq_maplen = ring->sq_maplen;
+    }
+    ring->sq_map = mmap(NULL, ring->sq_maplen, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED) {
+	ring->sq_map = NULL;
+	goto fail;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+	ring->cq_map = ring->sq_map;
+    } else {
+	ring->cq_map = mmap(NULL, ring->cq_maplen, PROT_READ | PROT_WRITE,
+			    MAP_SHARED | MAP_POPULATE, ring->fd,
+			    IORING_OFF_CQ_RING);
+	if (ring->cq_map == MAP_FAILED) {
+	    ring->cq_map = NULL;
+	    goto fail;
+	}
+    }
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+	ring->sqes = NULL;
+	goto fail;
+    }
+
+    sq = ring->sq_map;
+    cq = ring->cq_map;
+    ring->sq_head = (unsigned int *)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned int *)(sq + p.sq_off.array);
+    ring->sq_entries = p.sq_entries;
+    ring->cq_head = (unsigned int *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    /* the receive buffers. */
+    ring->rbr = mmap(NULL, RING_RBUFS * sizeof(struct io_uring_buf),
+		     PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+		     -1, 0);
+    if (ring->rbr == MAP_FAILED) {
+	ring->rbr = NULL;
+	goto fail;
+    }
+    memset(&reg, 0, sizeof reg);
+    reg.ring_addr = (__u64)(unsigned long)ring->rbr;
+    reg.ring_entries = RING_RBUFS;
+    reg.bgid = RING_BGID;
+    if (syscall(__NR_io_uring_register, ring->fd,
+		IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+	NE_DEBUG(NE_DBG_SOCKET, "io_uring buffer rings not available.\n");
+	goto fail;
+    }
+    ring->rbufs = ne_malloc(RING_RBUFS * RING_RBUFSIZ);
+    for (n = 0; n < RING_RBUFS; n++)
+	ring_recycle(ring, n);
+
+    /* the send buffers, which are copied from rather than mapped for
+     * each write if they can be registered. */
+    ring->wbufs = ne_malloc(RING_WBUFS * RING_WBUFSIZ);
+    iov.iov_base = ring->wbufs;
+    iov.iov_len = RING_WBUFS * RING_WBUFSIZ;
+    ring->fixed = syscall(__NR_io_uring_register, ring->fd,
+			  IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+    ring->wfree = -1;
+    for (n = RING_WBUFS; n-- > 0; )
+	ring_wfree(ring, n);
+
+    ring->slotfree = -1;
+    return ring;
+
+fail:
+    ring_free(ring);
+    return NULL;
+}
+
+int ne_sock_use_ring(ne_socket *sock, ne_sock_ring *ring, void *userdata)
+{
+    struct ring_slot *s;
+    unsigned int idx, n;
+
+    if (sock->ring == ring) {
+	s = &ring->slots[sock->ringslot];
+	s->userdata = userdata;
+	/* no callback is made whilst the slot has no userdata, so what
+	 * came or ended in the meantime is picked up here. */
+	if (userdata == NULL)
+	    return 0;
+	if (s->rhead >= 0 || s->error)
+	    ring_mark_ready(ring, sock->ringslot);
+	else if (!s->armed && ring_arm(ring, sock->ringslot)) {
+	    set_error(sock, _("Could not queue receive"));
+	    return -1;
+	}
+	return 0;
+    }
+    if (sock->ring != NULL || sock->ops != &iofns_raw) {
+	set_error(sock, _("Socket cannot use the ring"));
+	return -1;
+    }
+
+    if (ring->slotfree < 0) {
+	unsigned int old = ring->nslots;
+
+	ring->nslots = old ? old * 2 : 64;
+	ring->slots = ne_realloc(ring->slots,
+				 ring->nslots * sizeof *ring->slots);
+	memset(ring->slots + old, 0, (ring->nslots - old) * sizeof *s);
+	ring->ready = ne_realloc(ring->ready,
+				 ring->nslots * sizeof *ring->ready);
+	ring->running = ne_realloc(ring->running,
+				   ring->nslots * sizeof *ring->running);
+	ring->wpending = ne_realloc(ring->wpending,
+				    ring->nslots * sizeof *ring->wpending);
+	for (n = ring->nslots; n-- > old; ) {
+	    ring->slots[n].nextfree = ring->slotfree;
+	    ring->slotfree = n;
+	}
+    }
+    idx = ring->slotfree;
+    s = &ring->slots[idx];
+    ring->slotfree = s->nextfree;
+
+    s->sock = sock;
+    s->userdata = userdata;
+    s->rhead = s->rtail = s->whead = s->wtail = -1;
+    s->roff = s->woff = 0;
+    s->error = 0;
+    s->armed = s->sending = 0;
+    sock->ring = ring;
+    sock->ringslot = idx;
+    sock->ops = &iofns_ring;
+
+    if (ring_arm(ring, idx)) {
+	ring_detach(sock, 1);
+	set_error(sock, _("Could not queue receive"));
+	return -1;
+    }
+    return 0;
+}
+
+int ne_sock_ring_run(ne_sock_ring *ring, int ms, ne_sock_ring_fn fn,
+		     void *userdata)
+{
+    unsigned int *list, n, count;
+    struct ring_slot *s;
+
+    /* if sockets are ready already, only submit what is queued. */
+    if (ring_wait(ring, ring->nready ? 0 : ms))
+	return -1;
+
+    /* the callbacks may make more sockets ready, which wait for the
+     * next run. */
+    list = ring->ready;
+    ring->ready = ring->running;
+    ring->running = list;
+    count = ring->nready;
+    ring->nready = 0;
+
+    for (n = 0; n < count; n++) {
+	s = &ring->slots[ring->running[n]];
+	s->ready = 0;
+	if (s->sock && s->userdata)
+	    fn(userdata, s->userdata);
+    }
+    return count;
+}
+
+void ne_sock_ring_destroy(ne_sock_ring *ring)
+{
+    unsigned int n;
+
+    for (n = 0; n < ring->nslots; n++)
+	if (ring->slots[n].sock)
+	    ring_detach(ring->slots[n].sock, 1);
+    ring_free(ring);
+}
+
+#else /* !NE_USE_URING */
+
+ne_sock_ring *ne_sock_ring_create(unsigned int entries)
+{
+    return NULL;
+}
+
+int ne_sock_use_ring(ne_socket *sock, ne_sock_ring *ring, void *userdata)
+{
+    return -1;
+}
+
+int ne_sock_ring_run(ne_sock_ring *ring, int ms, ne_sock_ring_fn fn,
+		     void *userdata)
+{
+    return -1;
+}
+
+void ne_sock_ring_destroy(ne_sock_ring *ring)
+{
+}
+
+#endif /* NE_USE_URING */
+
 int ne_sock_fullwrite(ne_socket *sock, const char *data, size_t len)
 {
-    g_thrput += len;
     return sock->ops->write(sock, data, len);
 }
 
+int ne_sock_fullwritev(ne_socket *sock, const struct ne_iovec *vector,
+		       int count)
+{
+    return sock->ops->writev(sock, vector, count);
+}
+
+int ne_sock_nodelay(ne_socket *sock, int on)
+{
+    return setsockopt(sock->fd, IPPROTO_TCP, TCP_NODELAY, 
+		      &on, sizeof on) ? -1 : 0;
+}
+
+int ne_sock_cork(ne_socket *sock, int on)
+{
+#ifdef TCP_CORK
+    return setsockopt(sock->fd, IPPROTO_TCP, TCP_CORK, 
+		      &on, sizeof on) ? -1 : 0;
+#else
+    return -1;
+#endif
+}
+
+int ne_sock_sendfile(ne_socket *sock, int fd, off_t offset, off_t count)
+{
+    char buffer[BUFSIZ];
+    ssize_t ret;
+    int wret;
+
+#ifdef HAVE_SYS_SENDFILE_H
+    /* The kernel can only move the data itself onto a plain socket;
+     * through SSL, it has to be encrypted here. */
+    while (sock->ops == &iofns_raw && count > 0) {
+	sock->stats.writes++;
+	ret = sendfile(sock->fd, fd, &offset, count);
+	if (ret > 0) {
+	    count -= ret;
+	} else if (ret == 0) {
+	    set_error(sock, _("File truncated while sending"));
+	    return NE_SOCK_ERROR;
+	} else if (errno == EINVAL || errno == ENOSYS) {
+	    /* not for this kind of file: copy it instead. */
+	    break;
+	} else if (!NE_ISINTR(errno)) {
+	    int errnum = errno;
+	    set_strerror(sock, errnum);
+	    return MAP_ERR(errnum);
+	}
+    }
+#endif
+
+    while (count > 0) {
+	ret = pread(fd, buffer, count < BUFSIZ ? count : BUFSIZ, offset);
+	if (ret < 0 && NE_ISINTR(errno))
+	    continue;
+	if (ret <= 0) {
+	    if (ret < 0)
+		set_strerror(sock, errno);
+	    else
+		set_error(sock, _("File truncated while sending"));
+	    return NE_SOCK_ERROR;
+	}
+	wret = sock->ops->write(sock, buffer, ret);
+	if (wret < 0)
+	    return wret;
+	offset += ret;
+	count -= ret;
+    }
+
+    return 0;
+}
+
+/* Write 'len' bytes of 'data' to the file 'fd', or nowhere if 'fd' is
+ * -1.  Returns 0 on success, NE_SOCK_ERROR on error. */
+static int write_fd(ne_socket *sock, int fd, const char *data, size_t len)
+{
+    ssize_t ret;
+
+    while (fd >= 0 && len > 0) {
+	ret = write(fd, data, len);
+	if (ret < 0 && NE_ISINTR(errno))
+	    continue;
+	if (ret < 0) {
+	    set_strerror(sock, errno);
+	    return NE_SOCK_ERROR;
+	}
+	data += ret;
+	len -= ret;
+    }
+    return 0;
+}
+
+#ifdef SPLICE_F_MOVE
+/* Move 'count' bytes from the (plain) socket to 'out' through the
+ * pipe of the socket, in the kernel.  Returns the number of bytes
+ * moved, which is less than 'count' only if the kernel could not
+ * splice these file types, or NE_SOCK_* on error. */
+static ssize_t splice_raw(ne_socket *sock, int out, size_t count)
+{
+    size_t done = 0;
+    ssize_t ret, inpipe;
+
+    while (done < count) {
+	ret = readable_raw(sock, sock->rdtimeout);
+	if (ret) return ret;
+
+	sock->stats.reads++;
+	inpipe = splice(sock->fd, NULL, sock->pipe[1], NULL, count - done,
+			SPLICE_F_MOVE);
+	if (inpipe < 0 && NE_ISINTR(errno))
+	    continue;
+	if (inpipe == 0) {
+	    set_error(sock, _("Connection closed"));
+	    return NE_SOCK_CLOSED;
+	} else if (inpipe < 0) {
+	    int errnum = errno;
+	    if (errnum == EINVAL && done == 0)
+		return 0;
+	    set_strerror(sock, errnum);
+	    return MAP_ERR(errnum);
+	}
+
+	/* empty the pipe into 'out' again. */
+	while (inpipe > 0) {
+	    ret = splice(sock->pipe[0], NULL, out, NULL, inpipe, 
+			 SPLICE_F_MOVE);
+	    if (ret < 0 && NE_ISINTR(errno))
+		continue;
+	    if (ret < 0 && errno == EINVAL) {
+		/* 'out' won't take it this way: copy it out instead. */
+		char buffer[BUFSIZ];
+
+		ret = read(sock->pipe[0], buffer, 
+			   inpipe < BUFSIZ ? inpipe : BUFSIZ);
+		if (ret > 0 && write_fd(sock, out, buffer, ret))
+		    return NE_SOCK_ERROR;
+	    }
+	    if (ret <= 0) {
+		set_strerror(sock, errno);
+		return NE_SOCK_ERROR;
+	    }
+	    inpipe -= ret;
+	    done += ret;
+	}
+    }
+
+    return done;
+}
+#endif
+
+int ne_sock_splice(ne_socket *sock, int fd, size_t count)
+{
+    char buffer[BUFSIZ];
+    ssize_t ret;
+
+    /* data already read into the buffer goes first. */
+    while (sock->bufavail > 0 && count > 0) {
+	ret = ne_sock_read(sock, buffer, count < BUFSIZ ? count : BUFSIZ);
+	if (ret < 0)
+	    return ret;
+	if (write_fd(sock, fd, buffer, ret))
+	    return NE_SOCK_ERROR;
+	count -= ret;
+    }
+
+#ifdef SPLICE_F_MOVE
+    if (sock->ops == &iofns_raw && count > 0) {
+	int out = fd;
+
+	if (sock->pipe[0] < 0 && pipe(sock->pipe)) {
+	    sock->pipe[0] = -1;
+	    set_strerror(sock, errno);
+	    return NE_SOCK_ERROR;
+	}
+	if (fd < 0) {
+	    if (sock->nullfd < 0)
+		sock->nullfd = open("/dev/null", O_WRONLY);
+	    out = sock->nullfd;
+	}
+	if (out >= 0) {
+	    ret = splice_raw(sock, out, count);
+	    if (ret < 0)
+		return ret;
+	    count -= ret;
+	}
+    }
+#endif
+
+    while (count > 0) {
+	ret = ne_sock_read(sock, buffer, count < BUFSIZ ? count : BUFSIZ);
+	if (ret < 0)
+	    return ret;
+	if (write_fd(sock, fd, buffer, ret))
+	    return NE_SOCK_ERROR;
+	count -= ret;
+    }
+
+    return 0;
+}
+
 ssize_t ne_sock_readline(ne_socket *sock, char *buf, size_t buflen)
 {
-    char *lf;
-    size_t len;
+    size_t len, searched = 0;
     
-    if ((lf = memchr(sock->bufpos, '\n', sock->bufavail)) == NULL
-	&& sock->bufavail < RDBUFSIZ) {
-	/* The buffered data does not contain a complete line: move it
-	 * to the beginning of the buffer. */
-	if (sock->bufavail)
-	    memmove(sock->buffer, sock->bufpos, sock->bufavail);
-	sock->bufpos = sock->buffer;
-	
-	/* Loop filling the buffer whilst no newline is found in the data
-	 * buffered so far, and there is still buffer space available */ 
-	do {
-	    /* Read more data onto end of buffer. */
-	    ssize_t ret = sock->ops->read(sock, sock->buffer + sock->bufavail,
-					  RDBUFSIZ - sock->bufavail);
-	    if (ret < 0) return ret;
-	    sock->bufavail += ret;
-	} while ((lf = memchr(sock->buffer, '\n', sock->bufavail)) == NULL
-		 && sock->bufavail < RDBUFSIZ);
-    }
+    /* Loop filling the buffer whilst no newline is found in the data
+     * buffered so far, and the line could still fit both there and
+     * in 'buf'; only the data just read need be searched each time. */
+    while ((len = buf_find(sock, '\n', searched)) == 0) {
+	ssize_t ret;
+
+	searched = sock->bufavail;
+	if (searched + 1 >= buflen || searched == sock->bufsize) {
+	    set_error(sock, _("Line too long"));
+	    return NE_SOCK_ERROR;
+	}
 
-    if (lf)
-	len = lf - sock->bufpos + 1;
-    else
-	len = buflen; /* fall into "line too long" error... */
+	ret = buf_fill(sock);
+	if (ret < 0) return ret;
+    }
 
     if ((len + 1) > buflen) {
 	set_error(sock, _("Line too long"));
 	return NE_SOCK_ERROR;
     }
 
-    memcpy(buf, sock->bufpos, len);
-    buf[len] = '\0';
     /* consume the line from buffer: */
-    sock->bufavail -= len;
-    sock->bufpos += len;
+    buf_take(sock, buf, len, 1);
+    buf[len] = '\0';
     return len;
 }
 
@@ -626,6 +1837,98 @@ ssize_t ne_sock_fullread(ne_socket *sock, char *buffer, size_t buflen)
     return 0;
 }
 
+ssize_t ne_sock_fill(ne_socket *sock)
+{
+    ssize_t ret;
+    size_t space;
+    char *tail;
+
+#ifdef NEON_SSL
+    if (sock->ssl) {
+	set_error(sock, _("Not supported over SSL"));
+	return NE_SOCK_ERROR;
+    }
+#endif
+
+    if (sock->bufavail == sock->bufsize)
+	return 0;
+
+    space = buf_space(sock, &tail);
+#ifdef NE_USE_URING
+    if (sock->ring) {
+	/* what has arrived is already here. */
+	ret = ring_take(sock, tail, space);
+	if (ret > 0) {
+	    sock->bufavail += ret;
+	    sock->bufgrow = sock->bufavail == sock->bufsize;
+	}
+	return ret;
+    }
+#endif
+    do {
+	sock->stats.reads++;
+	ret = recv(sock->fd, tail, space, MSG_DONTWAIT);
+    } while (ret == -1 && NE_ISINTR(ne_errno));
+
+    if (ret == 0) {
+	set_error(sock, _("Connection closed"));
+	ret = NE_SOCK_CLOSED;
+    } else if (ret < 0) {
+	int errnum = ne_errno;
+	if (errnum == EAGAIN || errnum == EWOULDBLOCK)
+	    return 0;
+	ret = NE_ISRESET(errnum) ? NE_SOCK_RESET : NE_SOCK_ERROR;
+	set_strerror(sock, errnum);
+    } else {
+	sock->bufavail += ret;
+	sock->bufgrow = sock->bufavail == sock->bufsize;
+    }
+    
+    return ret;
+}
+
+size_t ne_sock_pending(const ne_socket *sock)
+{
+    return sock->bufavail;
+}
+
+int ne_sock_buffer_full(const ne_socket *sock)
+{
+    return sock->bufavail == sock->bufsize;
+}
+
+int ne_sock_buffered(const ne_socket *sock, const char *str)
+{
+    size_t n, k, len = strlen(str);
+    
+    for (n = 0; n + len <= sock->bufavail; n++) {
+	for (k = 0; k < len && BUF_AT(sock, n + k) == str[k]; k++)
+	    /* nothing */;
+	if (k == len)
+	    return n;
+    }
+    return -1;
+}
+
+void ne_sock_read_buffer(ne_socket *sock, size_t max)
+{
+    sock->bufmax = max > RDBUFSIZ ? max : RDBUFSIZ;
+}
+
+const ne_sock_stats *ne_sock_get_stats(ne_socket *sock)
+{
+#ifdef HAVE_STRUCT_TCP_INFO_TCPI_DATA_SEGS_OUT
+    struct tcp_info ti;
+    socklen_t len = sizeof ti;
+
+    if (getsockopt(sock->fd, IPPROTO_TCP, TCP_INFO, &ti, &len) == 0
+	&& len >= offsetof(struct tcp_info, tcpi_data_segs_out) 
+	+ sizeof ti.tcpi_data_segs_out)
+	sock->stats.segments = ti.tcpi_data_segs_out;
+#endif
+    return &sock->stats;
+}
+
 #ifndef INADDR_NONE
 #define INADDR_NONE ((unsigned long) -1)
 #endif
@@ -655,6 +1958,10 @@ ne_sock_addr *ne_addr_resolve(const char *hostname, int flags)
 	ne_free(hn);
     } else {
         hints.ai_family = ipv6_disabled ? AF_INET : AF_UNSPEC;
+	if (flags & NE_ADDR_IPV4)
+	    hints.ai_family = AF_INET;
+	else if (flags & NE_ADDR_IPV6)
+	    hints.ai_family = AF_INET6;
 	addr->errnum = getaddrinfo(hostname, NULL, &hints, &addr->result);
     }
 #else /* Use gethostbyname() */
@@ -662,7 +1969,10 @@ ne_sock_addr *ne_addr_resolve(const char *hostname, int flags)
     struct hostent *hp;
     
     laddr = inet_addr(hostname);
-    if (laddr == INADDR_NONE) {
+    if (flags & NE_ADDR_IPV6) {
+	/* only IPv4 can be had this way. */
+	addr->errnum = NO_DATA;
+    } else if (laddr == INADDR_NONE) {
 	hp = gethostbyname(hostname);
 	if (hp == NULL) {
 #ifdef WIN32
@@ -770,8 +2080,110 @@ char *ne_iaddr_print(const ne_inet_addr *ia, char *buf, size_t bufsiz)
     return buf;
 }
 
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t addr_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+#define CACHE_LOCK() pthread_mutex_lock(&addr_cache_lock)
+#define CACHE_UNLOCK() pthread_mutex_unlock(&addr_cache_lock)
+#else
+#define CACHE_LOCK()
+#define CACHE_UNLOCK()
+#endif
+
+static struct addr_entry *addr_cache;
+static int addr_cache_secs;
+
+/* Drop a reference to 'entry', freeing it with the last.  Called with
+ * the cache locked. */
+static void entry_release(struct addr_entry *entry)
+{
+    if (--entry->refs == 0) {
+	ne_addr_destroy(entry->addr);
+	ne_free(entry->hostname);
+	ne_free(entry);
+    }
+}
+
+ne_sock_addr *ne_addr_resolve_cached(const char *hostname, int flags)
+{
+    struct addr_entry *entry, **prev;
+    ne_sock_addr *addr;
+    time_t now = time(NULL);
+
+    if (addr_cache_secs <= 0)
+	return ne_addr_resolve(hostname, flags);
+
+    CACHE_LOCK();
+    for (prev = &addr_cache; (entry = *prev) != NULL; ) {
+	if (entry->expires <= now) {
+	    /* those still sharing it keep it until they are done. */
+	    *prev = entry->next;
+	    entry_release(entry);
+	    continue;
+	}
+	if (entry->flags == flags && strcmp(entry->hostname, hostname) == 0)
+	    break;
+	prev = &entry->next;
+    }
+    if (entry)
+	entry->refs++;
+    CACHE_UNLOCK();
+
+    if (entry == NULL) {
+	/* resolve it without holding the lock; should another thread
+	 * do the same meanwhile, the later entry is simply unused. */
+	NE_DEBUG(NE_DBG_SOCKET, "Address cache miss for %s.\n", hostname);
+	addr = ne_addr_resolve(hostname, flags);
+	if (ne_addr_result(addr))
+	    return addr;
+	entry = ne_calloc(sizeof *entry);
+	entry->hostname = ne_strdup(hostname);
+	entry->flags = flags;
+	entry->expires = now + addr_cache_secs;
+	entry->addr = addr;
+	entry->refs = 2;
+	CACHE_LOCK();
+	entry->next = addr_cache;
+	addr_cache = entry;
+	CACHE_UNLOCK();
+    }
+
+    addr = ne_calloc(sizeof *addr);
+    addr->entry = entry;
+#ifdef USE_GETADDRINFO
+    addr->result = entry->addr->result;
+#else
+    addr->addrs = entry->addr->addrs;
+    addr->count = entry->addr->count;
+#endif
+    return addr;
+}
+
+void ne_addr_cache_ttl(int seconds)
+{
+    addr_cache_secs = seconds;
+}
+
+void ne_addr_cache_flush(void)
+{
+    struct addr_entry *entry;
+
+    CACHE_LOCK();
+    while ((entry = addr_cache) != NULL) {
+	addr_cache = entry->next;
+	entry_release(entry);
+    }
+    CACHE_UNLOCK();
+}
+
 void ne_addr_destroy(ne_sock_addr *addr)
 {
+    if (addr->entry) {
+	CACHE_LOCK();
+	entry_release(addr->entry);
+	CACHE_UNLOCK();
+	ne_free(addr);
+	return;
+    }
 #ifdef USE_GETADDRINFO
     if (addr->result)
 	freeaddrinfo(addr->result);
@@ -817,15 +2229,18 @@ static ne_socket *create_sock(int fd)
     ne_socket *sock = ne_calloc(sizeof *sock);
     sock->fd = fd;
     sock->rdtimeout = SOCKET_READ_TIMEOUT;
-    sock->bufpos = sock->buffer;
+    sock->buffer = ne_malloc(RDBUFSIZ);
+    sock->bufsize = sock->bufmax = RDBUFSIZ;
     sock->ops = &iofns_raw;
+    sock->pipe[0] = sock->pipe[1] = sock->nullfd = -1;
     return sock;
 }
 
-ne_socket *ne_sock_connect(const ne_inet_addr *addr, unsigned int portnum)
+/* Returns a new TCP socket of the family of 'addr', with TCP_NODELAY
+ * set, or -1 on error (details in errno). */
+static int open_fd(const ne_inet_addr *addr)
 {
-    int fd;
-    int len, val;
+    int fd, val = 1;
 
 #ifdef USE_GETADDRINFO
     /* use SOCK_STREAM rather than ai_socktype: some getaddrinfo
@@ -835,23 +2250,151 @@ ne_socket *ne_sock_connect(const ne_inet_addr *addr, unsigned int portnum)
     fd = socket(AF_INET, SOCK_STREAM, 0);
 #endif
     if (fd < 0)
-	return NULL;
+	return -1;
 
-    val = 1;
-   if (setsockopt(fd, SOL_TCP, TCP_NODELAY, &val, sizeof(val)) < 0){
-       	perror("setsockopt() :");
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof val) < 0) {
+	int errnum = errno;
+	ne_close(fd);
+	errno = errnum;
 	return -1;
-   }
+    }
+    return fd;
+}
 
+ne_socket *ne_sock_connect(const ne_inet_addr *addr, unsigned int portnum)
+{
+    return ne_sock_connect_race(&addr, 1, portnum, -1, NULL);
+}
 
-    if (raw_connect(fd, addr, ntohs(portnum))) {
-	ne_close(fd);
+ne_socket *ne_sock_connect_ms(const ne_inet_addr *addr, unsigned int portnum,
+			      int ms)
+{
+    return ne_sock_connect_race(&addr, 1, portnum, ms, NULL);
+}
+
+#if defined(HAVE_POLL_H) && defined(O_NONBLOCK)
+
+/* most addresses raced at once. */
+#define RACE_MAX (16)
+
+ne_socket *ne_sock_connect_race(const ne_inet_addr *const *addrs, int count,
+				unsigned int portnum, int ms, int *which)
+{
+    struct pollfd pfd[RACE_MAX];
+    int idx[RACE_MAX], flags[RACE_MAX];
+    int n, m, live = 0, won = -1, errnum = ECONNREFUSED;
+    ne_hrtime deadline = 0;
+
+    if (count > RACE_MAX)
+	count = RACE_MAX;
+    if (ms >= 0)
+	deadline = ne_hrtime_now() + ms * (ne_hrtime)1000000;
+
+    /* Start connecting to each address at once. */
+    for (n = 0; n < count && won < 0; n++) {
+	int fd = open_fd(addrs[n]);
+
+	if (fd < 0) {
+	    errnum = errno;
+	    continue;
+	}
+	flags[live] = fcntl(fd, F_GETFL);
+	fcntl(fd, F_SETFL, flags[live] | O_NONBLOCK);
+	pfd[live].fd = fd;
+	pfd[live].events = POLLOUT;
+	idx[live] = n;
+	if (raw_connect(fd, addrs[n], ntohs(portnum)) == 0) {
+	    won = live++;
+	} else if (errno == EINPROGRESS) {
+	    live++;
+	} else {
+	    errnum = errno;
+	    ne_close(fd);
+	}
+    }
+
+    /* The first to complete wins. */
+    while (won < 0 && live > 0) {
+	int left = -1, ret;
+
+	if (ms >= 0) {
+	    ne_hrtime now = ne_hrtime_now();
+	    left = now < deadline ? (deadline - now + 999999) / 1000000 : 0;
+	}
+	do {
+	    ret = poll(pfd, live, left);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0) {
+	    errnum = errno;
+	    break;
+	} else if (ret == 0) {
+	    errnum = ETIMEDOUT;
+	    break;
+	}
+
+	for (n = 0; n < live && won < 0; n++) {
+	    int err = 0;
+	    socklen_t len = sizeof err;
+
+	    if (pfd[n].revents == 0)
+		continue;
+	    if (getsockopt(pfd[n].fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+		err = errno;
+	    if (err == 0) {
+		won = n;
+		continue;
+	    }
+	    errnum = err;
+	    ne_close(pfd[n].fd);
+	    live--;
+	    pfd[n] = pfd[live];
+	    idx[n] = idx[live];
+	    flags[n] = flags[live];
+	    n--;
+	}
+    }
+
+    for (m = 0; m < live; m++)
+	if (m != won)
+	    ne_close(pfd[m].fd);
+
+    if (won < 0) {
+	errno = errnum;
 	return NULL;
     }
 
-    return create_sock(fd);
+    /* the rest of the socket code expects blocking I/O. */
+    fcntl(pfd[won].fd, F_SETFL, flags[won]);
+    if (which)
+	*which = idx[won];
+    return create_sock(pfd[won].fd);
 }
 
+#else /* !HAVE_POLL_H */
+
+/* Without poll(), each address is tried in turn, and the connect
+ * blocks for as long as the kernel lets it. */
+ne_socket *ne_sock_connect_race(const ne_inet_addr *const *addrs, int count,
+				unsigned int portnum, int ms, int *which)
+{
+    int n, fd;
+
+    for (n = 0; n < count; n++) {
+	fd = open_fd(addrs[n]);
+	if (fd < 0)
+	    continue;
+	if (raw_connect(fd, addrs[n], ntohs(portnum)) == 0) {
+	    if (which)
+		*which = n;
+	    return create_sock(fd);
+	}
+	ne_close(fd);
+    }
+    return NULL;
+}
+
+#endif /* HAVE_POLL_H */
+
 ne_inet_addr *ne_iaddr_make(ne_iaddr_type type, const unsigned char *raw)
 {
     ne_inet_addr *ia;
@@ -933,7 +2476,12 @@ int ne_sock_fd(const ne_socket *sock)
 
 void ne_sock_read_timeout(ne_socket *sock, int timeout)
 {
-    sock->rdtimeout = timeout;
+    sock->rdtimeout = timeout * 1000;
+}
+
+void ne_sock_read_timeout_ms(ne_socket *sock, int ms)
+{
+    sock->rdtimeout = ms;
 }
 
 #ifdef NEON_SSL
@@ -1017,8 +2565,19 @@ int ne_sock_close(ne_socket *sock)
 	if (sock->ssl_ctx)
 	    SSL_CTX_free(sock->ssl_ctx);
     }
+#endif
+    if (sock->pipe[0] >= 0) {
+	close(sock->pipe[0]);
+	close(sock->pipe[1]);
+    }
+    if (sock->nullfd >= 0)
+	close(sock->nullfd);
+#ifdef NE_USE_URING
+    if (sock->ring)
+	ring_detach(sock, 0);
 #endif
     ret = ne_close(sock->fd);
+    ne_free(sock->buffer);
     ne_free(sock);
     return ret;
 }
@@ -65,11 +65,30 @@ int ne_sock_init(void);
 /* Shutdown any underlying libraries. */
 void ne_sock_exit(void);
 
-/* Resolve the given hostname.  'flags' are currently ignored.  Hex
- * string IPv6 addresses (e.g. `::1') may be enclosed in brackets
- * (e.g. `[::1]'). */
+/* Flags for ne_addr_resolve: look for IPv4, or IPv6, addresses
+ * only. */
+#define NE_ADDR_IPV4 (0x01)
+#define NE_ADDR_IPV6 (0x02)
+
+/* Resolve the given hostname.  'flags' is zero, or one of the NE_ADDR_*
+ * flags above.  Hex string IPv6 addresses (e.g. `::1') may be
+ * enclosed in brackets (e.g. `[::1]'). */
 ne_sock_addr *ne_addr_resolve(const char *hostname, int flags);
 
+/* As ne_addr_resolve, but through a process-wide cache shared by all
+ * threads: a hostname is only resolved again once its result is
+ * older than the cache TTL.  Failures are not cached.  The object
+ * returned is destroyed with ne_addr_destroy as usual. */
+ne_sock_addr *ne_addr_resolve_cached(const char *hostname, int flags);
+
+/* Set the TTL of the entries of the address cache, in seconds.  The
+ * default of zero disables the cache, so that ne_addr_resolve_cached
+ * always resolves the hostname afresh. */
+void ne_addr_cache_ttl(int seconds);
+
+/* Empty the address cache. */
+void ne_addr_cache_flush(void);
+
 /* Returns zero if name resolution was successful, non-zero on
  * error. */
 int ne_addr_result(const ne_sock_addr *addr);
@@ -145,6 +164,42 @@ int ne_sock_block(ne_socket *sock, int n);
  * Returns 0 on success, NE_SOCK_* on error. */
 int ne_sock_fullwrite(ne_socket *sock, const char *data, size_t count); 
 
+/* A block of data to be written by ne_sock_fullwritev. */
+struct ne_iovec {
+    const char *base;
+    size_t len;
+};
+
+/* Writes the 'count' blocks of 'vector' to the socket, one after the
+ * other, in as few system calls as possible: on a plain socket,
+ * writev() where the platform has it.  Returns 0 on success, NE_SOCK_*
+ * on error. */
+int ne_sock_fullwritev(ne_socket *sock, const struct ne_iovec *vector,
+		       int count);
+
+/* Sets (if 'on' is non-zero) or clears TCP_NODELAY on the socket,
+ * which is set when it is connected.  Returns non-zero on error. */
+int ne_sock_nodelay(ne_socket *sock, int on);
+
+/* Corks the socket (TCP_CORK), if 'on' is non-zero, so that what is
+ * written goes out in full segments only; or uncorks it, sending any
+ * partial segment held back.  Returns non-zero on error, or where the
+ * platform cannot cork sockets. */
+int ne_sock_cork(ne_socket *sock, int on);
+
+/* Writes 'count' bytes of the file 'fd', starting at 'offset', to the
+ * socket.  The file position of 'fd' is left alone.  On a plain
+ * socket the data goes straight from the file to the socket with
+ * sendfile(), where the platform has it, rather than through a buffer
+ * here.  Returns 0 on success, NE_SOCK_* on error. */
+int ne_sock_sendfile(ne_socket *sock, int fd, off_t offset, off_t count);
+
+/* Reads 'count' bytes from the socket and writes them to the file
+ * 'fd', or discards them if 'fd' is -1.  On a plain socket the data
+ * is moved with splice(), where the platform has it, without being
+ * copied through here.  Returns 0 on success, NE_SOCK_* on error. */
+int ne_sock_splice(ne_socket *sock, int fd, size_t count);
+
 /* Reads an LF-terminated line into 'buffer', and NUL-terminate it.
  * At most 'len' bytes are read (including the NUL terminator).
  * Returns:
@@ -157,11 +212,46 @@ ssize_t ne_sock_readline(ne_socket *sock, char *buffer, size_t len);
  * on error. */
 ssize_t ne_sock_fullread(ne_socket *sock, char *buffer, size_t len);
 
+/* For driving the socket from an event loop: read whatever data has
+ * arrived onto the end of the read buffer, without waiting for any.
+ * Returns:
+ *  NE_SOCK_* on error (always for SSL sockets, not supported),
+ *  0 if there was nothing to read or the buffer is full,
+ *  >0 number of bytes read.
+ */
+ssize_t ne_sock_fill(ne_socket *sock);
+
+/* Returns the number of bytes read from the socket which have not yet
+ * been consumed. */
+size_t ne_sock_pending(const ne_socket *sock);
+
+/* Returns non-zero if the read buffer can take no more data. */
+int ne_sock_buffer_full(const ne_socket *sock);
+
+/* Returns the offset of the first occurrence of 'str' in the data
+ * read from the socket but not yet consumed, or -1 if there is
+ * none. */
+int ne_sock_buffered(const ne_socket *sock, const char *str);
+
 /* Create a TCP socket connected to server at address 'addr' on port
  * 'port'.  Returns NULL if a connection could not be established.
  * (error details in errno). */
 ne_socket *ne_sock_connect(const ne_inet_addr *addr, unsigned int port);
 
+/* As ne_sock_connect, giving up after 'ms' milliseconds (errno is
+ * then ETIMEDOUT); a negative timeout means wait for ever. */
+ne_socket *ne_sock_connect_ms(const ne_inet_addr *addr, unsigned int port,
+			      int ms);
+
+/* Connect to all 'count' addresses of 'addrs' at once, and return the
+ * socket of the first to be established; the others are abandoned.
+ * If 'which' is non-NULL, the index of the winning address is stored
+ * there.  Returns NULL if none could be connected to within 'ms'
+ * milliseconds (details in errno).  Where poll() is not available,
+ * the addresses are tried in turn, and the timeout is ignored. */
+ne_socket *ne_sock_connect_race(const ne_inet_addr *const *addrs, int count,
+				unsigned int port, int ms, int *which);
+
 /* Accept a connection on listening socket 'fd'. */
 ne_socket *ne_sock_accept(int fd);
 
@@ -175,8 +265,64 @@ int ne_sock_close(ne_socket *sock);
 /* Return current error string for socket. */
 const char *ne_sock_error(const ne_socket *sock);
 
-/* Set read timeout for socket. */
+/* Set read timeout for socket, in seconds (or milliseconds for the
+ * _ms variant); a negative timeout means wait for ever. */
 void ne_sock_read_timeout(ne_socket *sock, int timeout);
+void ne_sock_read_timeout_ms(ne_socket *sock, int ms);
+
+/* Let the read buffer of the socket grow, as reads keep filling it,
+ * up to 'max' bytes; it starts at 4K, and stays there by default.  A
+ * larger buffer takes fewer read calls to receive a large response. */
+void ne_sock_read_buffer(ne_socket *sock, size_t max);
+
+/* Counts of the system calls made on a socket since it was created,
+ * and of the TCP segments it has sent. */
+typedef struct {
+    unsigned long reads; /* read(), recv() or splice() from it */
+    unsigned long writes; /* write(), writev() or sendfile() to it */
+    unsigned long waits; /* waits for it to be readable */
+    unsigned long segments; /* data segments sent, where the kernel
+			     * reports it (Linux); else zero */
+} ne_sock_stats;
+
+const ne_sock_stats *ne_sock_get_stats(ne_socket *sock);
+
+/* An ne_sock_ring drives the I/O of many sockets through one Linux
+ * io_uring: each socket's data arrives by a multishot receive into
+ * buffers shared with the kernel, and writes are queued, from buffers
+ * registered with it, to be submitted together with those of the
+ * other sockets at the next wait.  Reads and writes on such sockets
+ * are no longer system calls of their own, and are not counted in
+ * ne_sock_stats. */
+typedef struct ne_sock_ring_s ne_sock_ring;
+
+/* Returns a new ring with a submission queue of (at least) 'entries'
+ * entries, or NULL if the platform or kernel does not support it. */
+ne_sock_ring *ne_sock_ring_create(unsigned int entries);
+
+/* Moves the I/O of socket 'sock' onto the ring, if not there already,
+ * and sets the 'userdata' passed back by ne_sock_ring_run when data
+ * arrives for it.  With a NULL 'userdata' no callback is made for it
+ * until one is set again.  Not supported over SSL.  Returns non-zero
+ * on error. */
+int ne_sock_use_ring(ne_socket *sock, ne_sock_ring *ring, void *userdata);
+
+/* Called by ne_sock_ring_run for each socket on the ring for which
+ * data, EOF or an error has arrived, with the 'userdata' given to
+ * ne_sock_ring_run and the 'sockdata' given to ne_sock_use_ring. */
+typedef void (*ne_sock_ring_fn)(void *userdata, void *sockdata);
+
+/* Submits the writes queued on the ring, and waits up to 'ms'
+ * milliseconds (or for ever if negative) for I/O to complete; then
+ * calls 'fn' for each socket with data to be read.  Returns the
+ * number of sockets so found, or -1 on error. */
+int ne_sock_ring_run(ne_sock_ring *ring, int ms, ne_sock_ring_fn fn, 
+		     void *userdata);
+
+/* Destroys the ring, once the writes queued on it have gone out; the
+ * sockets still using it go back to plain I/O, keeping any data which
+ * has arrived. */
+void ne_sock_ring_destroy(ne_sock_ring *ring);
 
 /* Returns the standard TCP port for the given service, or zero if
  * none is known. */
@@ -30,6 +30,11 @@
 #include <stdio.h>
 #include <ctype.h> /* isdigit() for ne_parse_statusline */
 
+#include <sys/time.h>
+#ifdef HAVE_CLOCK_GETTIME
+#include <time.h>
+#endif
+
 #include "ne_utils.h"
 #include "ne_string.h" /* for ne_strdup */
 #include "ne_dates.h"
@@ -187,3 +192,17 @@ int ne_parse_statusline(const char *status_line, ne_status *st)
     st->klass = klass;
     return 0;
 }
+
+ne_hrtime ne_hrtime_now(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+	return (ne_hrtime)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+    {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (ne_hrtime)tv.tv_sec * 1000000000ULL + tv.tv_usec * 1000ULL;
+    }
+}
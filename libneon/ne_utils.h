@@ -122,6 +122,14 @@ typedef struct {
  */
 int ne_parse_statusline(const char *status_line, ne_status *s);
 
+/* A point in time, in nanoseconds.  Only differences between two
+ * values are meaningful. */
+typedef unsigned long long ne_hrtime;
+
+/* Returns the current time of a monotonic clock where the system has
+ * one, else of the time-of-day clock. */
+ne_hrtime ne_hrtime_now(void);
+
 END_NEON_DECLS
 
 #endif /* NE_UTILS_H */
@@ -59,6 +59,15 @@ typedef xmlChar ne_xml_char;
 /* Approx. one screen of text: */
 #define ERR_SIZE (2048)
 
+/* Size of the table of interned strings */
+#define ATOM_HASH_SIZE (31)
+
+struct ne_xml_atom {
+    const ne_xml_char *str;
+    size_t len;
+    struct ne_xml_atom *next;
+};
+
 /* A list of elements */
 struct ne_xml_handler {
     const struct ne_xml_elm *elements; /* put it in static memory */
@@ -81,9 +90,10 @@ struct ne_xml_state {
     /* Storage for an unknown element */
     struct ne_xml_elm elm_real;
     char *real_name;
+    size_t real_size; /* space allocated for real_name */
     
     /* Namespaces declared in this element */
-    ne_xml_char *default_ns; /* A default namespace */
+    const ne_xml_char *default_ns; /* A default namespace */
     struct ne_xml_nspace *nspaces; /* List of other namespace scopes */
 
     unsigned int mixed:1; /* are we in MIXED mode? */
@@ -107,6 +117,13 @@ struct ne_xml_parser_s {
     unsigned int collect; /* current collect depth */
     struct ne_xml_handler *top_handlers; /* always points at the 
 					   * handler on top of the stack. */
+    /* States and namespace scopes of elements which have ended, kept
+     * for reuse by the elements which follow. */
+    struct ne_xml_state *spare_states;
+    struct ne_xml_nspace *spare_nspaces;
+    /* Namespace URIs and prefixes, interned once per document. */
+    ne_pool *atoms;
+    struct ne_xml_atom *atom_table[ATOM_HASH_SIZE];
 #ifdef HAVE_EXPAT
     XML_Parser parser;
     char *encoding;
@@ -116,6 +133,7 @@ struct ne_xml_parser_s {
     char error[ERR_SIZE];
 };
 
+static void release_state(ne_xml_parser *p, struct ne_xml_state *s);
 static void destroy_state(struct ne_xml_state *s);
 
 static const char *friendly_name(const struct ne_xml_elm *elm)
@@ -142,10 +160,11 @@ static void start_element(void *userdata, const ne_xml_char *name, const ne_xml_
 static void end_element(void *userdata, const ne_xml_char *name);
 static void char_data(void *userdata, const ne_xml_char *cdata, int len);
 
-/* Linked list of namespace scopes */
+/* Linked list of namespace scopes; the name and URI are interned. */
 struct ne_xml_nspace {
-    ne_xml_char *name;
-    ne_xml_char *uri;
+    const ne_xml_char *name;
+    size_t namelen;
+    const ne_xml_char *uri;
     struct ne_xml_nspace *next;
 };
 
@@ -327,7 +346,17 @@ static void start_element(void *userdata, const ne_xml_char *name,
     }
 
     /* Set the new state */
-    s = ne_calloc(sizeof(struct ne_xml_state));
+    s = p->spare_states;
+    if (s) {
+	char *real_name = s->real_name;
+	size_t real_size = s->real_size;
+	p->spare_states = s->parent;
+	memset(s, 0, sizeof *s);
+	s->real_name = real_name;
+	s->real_size = real_size;
+    } else {
+	s = ne_calloc(sizeof(struct ne_xml_state));
+    }
     s->parent = p->current;
     p->current = s;
 
@@ -373,18 +402,30 @@ static void start_element(void *userdata, const ne_xml_char *name,
 
 }
 
+/* Puts given state, and its namespace scopes, on the spare lists. */
+static void release_state(ne_xml_parser *p, struct ne_xml_state *s)
+{
+    struct ne_xml_nspace *ns, *next_ns;
+
+    for (ns = s->nspaces; ns != NULL; ns = next_ns) {
+	next_ns = ns->next;
+	ns->next = p->spare_nspaces;
+	p->spare_nspaces = ns;
+    }
+    s->nspaces = NULL;
+    s->parent = p->spare_states;
+    p->spare_states = s;
+}
+
 /* Destroys given state */
 static void destroy_state(struct ne_xml_state *s) 
 {
     struct ne_xml_nspace *this_ns, *next_ns;
-    NE_FREE(s->default_ns);
     NE_FREE(s->real_name);
     /* Free the namespaces */
     this_ns = s->nspaces;
     while (this_ns != NULL) {
 	next_ns = this_ns->next;
-	ne_free(this_ns->name);
-	ne_free(this_ns->uri);
 	ne_free(this_ns);
 	this_ns = next_ns;
     };
@@ -468,7 +509,7 @@ static void end_element(void *userdata, const ne_xml_char *name)
     if (p->want_cdata) {
 	ne_buffer_clear(p->buffer);
     } 
-    destroy_state(s);
+    release_state(p, s);
 }
 
 /* Find a namespace definition for 'prefix' in given parser state,
@@ -484,7 +525,7 @@ resolve_nspace(const struct ne_xml_state *state,
 	const struct ne_xml_nspace *ns;
 	/* Iterate over defined spaces on this node. */
 	for (ns = s->nspaces; ns != NULL; ns = ns->next) {
-	    if (strlen(ns->name) == pfxlen && 
+	    if (ns->namelen == pfxlen && 
 		memcmp(ns->name, prefix, pfxlen) == 0)
 		return ns->uri;
 	}
@@ -493,6 +534,48 @@ resolve_nspace(const struct ne_xml_state *state,
     return NULL;
 }
 
+/* Returns the interned copy of 'str', of length 'len', which lasts as
+ * long as the parser. */
+static const ne_xml_char *
+intern(ne_xml_parser *p, const ne_xml_char *str, size_t len)
+{
+    struct ne_xml_atom *atom;
+    unsigned int hash = 0;
+    size_t n;
+    ne_xml_char *copy;
+
+    for (n = 0; n < len; n++)
+	hash = hash * 33 + (unsigned char)str[n];
+    hash %= ATOM_HASH_SIZE;
+
+    for (atom = p->atom_table[hash]; atom != NULL; atom = atom->next)
+	if (atom->len == len && memcmp(atom->str, str, len) == 0)
+	    return atom->str;
+
+    copy = ne_pool_alloc(p->atoms, len + 1);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    atom = ne_pool_alloc(p->atoms, sizeof *atom);
+    atom->str = copy;
+    atom->len = len;
+    atom->next = p->atom_table[hash];
+    p->atom_table[hash] = atom;
+    return copy;
+}
+
+/* Sets the local name of the element for 'state', reusing the space
+ * left by any element which had the state before. */
+static void set_name(struct ne_xml_state *state, const ne_xml_char *name)
+{
+    size_t len = strlen((const char *)name) + 1;
+
+    if (len > state->real_size) {
+	state->real_name = ne_realloc(state->real_name, len);
+	state->real_size = len;
+    }
+    memcpy(state->real_name, name, len);
+}
+
 /* Parses the attributes, and handles XML namespaces. 
  * With a little bit of luck.
  * Returns:
@@ -516,7 +599,8 @@ static int parse_element(ne_xml_parser *p, struct ne_xml_state *state,
 		     atts[attn], atts[attn+1]);
 	    if (strcasecmp(atts[attn], "xmlns") == 0) {
 		/* New default namespace */
-		state->default_ns = ne_strdup(atts[attn+1]);
+		state->default_ns = intern(p, atts[attn+1], 
+					   strlen(atts[attn+1]));
 		NE_DEBUG(NE_DBG_XMLPARSE, "New default namespace: %s\n", 
 			 state->default_ns);
 		/* FIXME: if attribute value is empty, then this means
@@ -534,11 +618,18 @@ static int parse_element(ne_xml_parser *p, struct ne_xml_state *state,
 		    return -1;
 		}
 		/* New namespace scope */
-		ns = ne_calloc(sizeof(struct ne_xml_nspace));
+		ns = p->spare_nspaces;
+		if (ns) {
+		    p->spare_nspaces = ns->next;
+		} else {
+		    ns = ne_malloc(sizeof(struct ne_xml_nspace));
+		}
 		ns->next = state->nspaces;
 		state->nspaces = ns;
-		ns->name = ne_strdup(atts[attn]+6); /* skip the xmlns= */
-		ns->uri = ne_strdup(atts[attn+1]);
+		/* skip the xmlns= */
+		ns->namelen = strlen(atts[attn]+6);
+		ns->name = intern(p, atts[attn]+6, ns->namelen);
+		ns->uri = intern(p, atts[attn+1], strlen(atts[attn+1]));
 		NE_DEBUG(NE_DBG_XMLPARSE, "New namespace scope: %s -> %s\n",
 			 ns->name, ns->uri);
 	    }
@@ -548,7 +639,7 @@ static int parse_element(ne_xml_parser *p, struct ne_xml_state *state,
     pnt = strchr(name, ':');
     if (pnt == NULL) {
 	/* No namespace prefix - have we got a default? */
-	state->real_name = ne_strdup(name);
+	set_name(state, name);
 	NE_DEBUG(NE_DBG_XMLPARSE, "No prefix found, searching for default.\n");
 	for (xmlt = state; xmlt!=NULL; xmlt=xmlt->parent) {
 	    if (xmlt->default_ns != NULL) {
@@ -576,7 +667,7 @@ static int parse_element(ne_xml_parser *p, struct ne_xml_state *state,
 			 "No element name after ':'. Failed.\n");
 		return -1;
 	    }
-	    state->real_name = ne_strdup(pnt+1);
+	    set_name(state, pnt+1);
 	} else {
 	    NE_DEBUG(NE_DBG_XMLPARSE, "Undeclared namespace.\n");
 	    ne_snprintf(p->error, ERR_SIZE, 
@@ -599,6 +690,7 @@ ne_xml_parser *ne_xml_create(void)
     p->root->elm = &root_element;
     /* Initialize the cdata buffer */
     p->buffer = ne_buffer_create();
+    p->atoms = ne_pool_create(1024);
 #ifdef HAVE_EXPAT
     p->parser = XML_ParserCreate(NULL);
     if (p->parser == NULL) {
@@ -749,6 +841,16 @@ void ne_xml_destroy(ne_xml_parser *p)
 	parent = s->parent;
 	destroy_state(s);
     }
+    for (s = p->spare_states; s!=NULL; s=parent) {
+	parent = s->parent;
+	destroy_state(s);
+    }
+    while (p->spare_nspaces) {
+	struct ne_xml_nspace *ns = p->spare_nspaces;
+	p->spare_nspaces = ns->next;
+	ne_free(ns);
+    }
+    ne_pool_destroy(p->atoms);
 	 
 #ifdef HAVE_EXPAT
     XML_ParserFree(p->parser);
@@ -482,13 +482,14 @@ dnl Is strerror_r present; if so, which variant
 AC_REQUIRE([AC_FUNC_STRERROR_R])
 
 AC_CHECK_HEADERS([strings.h sys/time.h limits.h sys/select.h arpa/inet.h \
-	signal.h sys/socket.h netinet/in.h netdb.h])
+	signal.h sys/socket.h netinet/in.h netdb.h sys/epoll.h sys/sendfile.h \
+	poll.h sys/uio.h linux/io_uring.h pthread.h])
 
 AC_REQUIRE([NE_SNPRINTF])
 
 AC_REPLACE_FUNCS(strcasecmp)
 
-AC_CHECK_FUNCS(signal setvbuf setsockopt stpcpy)
+AC_CHECK_FUNCS(signal setvbuf setsockopt stpcpy clock_gettime)
 
 # Unixware 7 can only link gethostbyname with -lnsl -lsocket
 # Pick up -lsocket first, then the gethostbyname check will work.
@@ -514,6 +515,12 @@ AC_CHECK_MEMBERS(struct tm.tm_gmtoff,,
 AC_MSG_WARN([no timezone handling in date parsing on this platform]),
 [#include <time.h>])
 
+# The count of segments sent on a connection is only in the kernel's
+# own definition of struct tcp_info.
+AC_CHECK_MEMBERS(struct tcp_info.tcpi_data_segs_out,,,
+[#include <netinet/in.h>
+#include <linux/tcp.h>])
+
 ifdef([neon_no_zlib], [
     neon_zlib_message="zlib disabled"
     NEON_SUPPORTS_ZLIB=no
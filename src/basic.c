@@ -3,6 +3,7 @@
 
 #include <sys/types.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include <string.h>
 #include <unistd.h>
@@ -16,13 +17,13 @@
 #include <ne_props.h>
 #include <ne_uri.h>
 #include <ne_locks.h>
+#include <ne_async.h>
 
 #include "common.h"
 
-static char buff[1024];
-static struct ne_lock reslock;
+static PER_WORKER char buff[1024];
+static PER_WORKER struct ne_lock reslock;
 
-extern struct timeval g_tv1, g_tv2;
 
 /* BINARYMODE() enables binary file I/O on cygwin. */
 #ifdef __CYGWIN__
@@ -31,9 +32,11 @@ extern struct timeval g_tv1, g_tv2;
 #define BINARYMODE(fd) if (0)
 #endif
 
-#define MAXNP 1024
-static ne_propname propnames[MAXNP+1];
-static char *values[MAXNP+1];
+/* the live properties found by wf_my_single, and the entry which
+ * ends them. */
+#define NLIVE 11
+static PER_WORKER ne_propname propnames[NLIVE+1];
+static PER_WORKER char *values[NLIVE+1];
 
 
 static char *create_temp(const char *contents, int fsize)
@@ -64,13 +67,14 @@ static const char *test_contents = ""
 "for Prestan\n"
 "testing.\n";
 
-static char *pg_uri = NULL;
+static PER_WORKER char *pg_uri = NULL;
 
 static int do_put_get(const char *segment, int fsize)
 {
     char *fn, tmp[] = "/tmp/Davtest-XXXXXX", *uri;
     char str[64];
     int fd, res;
+    off_t got = 0;
     
     uri = ne_concat(i_path, segment, NULL);
     fn = create_temp(test_contents, fsize);
@@ -80,6 +84,7 @@ static int do_put_get(const char *segment, int fsize)
     SEND_REQUEST(ne_put(i_session, uri, fd));
     memset(str, 0, sizeof(str));
     sprintf(str, "Put%dK", fsize);
+    g_op_bytes = fsize * sizeof(buff);
     my_printf(str);
 
     close(fd);
@@ -88,9 +93,16 @@ static int do_put_get(const char *segment, int fsize)
     fd = mkstemp(tmp);
     BINARYMODE(fd);
 
-    SEND_REQUEST(ne_get(i_session, uri, fd));
+    if (pget_option.sink == SINK_NULL) {
+	SEND_REQUEST(ne_get_sink(i_session, uri, -1, &got));
+    } else if (pget_option.sink == SINK_FILE) {
+	SEND_REQUEST(ne_get_sink(i_session, uri, fd, &got));
+    } else {
+	SEND_REQUEST(ne_get(i_session, uri, fd));
+    }
     memset(str, 0, sizeof(str));
     sprintf(str, "Get%dK", fsize);
+    g_op_bytes = pget_option.sink ? got : fsize * sizeof(buff);
     my_printf(str);
  
     close(fd);
@@ -118,6 +130,225 @@ int put_get1024K(void)
     return do_put_get("res", 1024);
 }
 
+/* State of async_get1K: the requests still to be started, and those
+ * which have failed. */
+struct async_ctx {
+    ne_async *as;
+    ne_request_template *tpl; /* GET of the resource */
+    const char *uri;
+    int tostart, failed;
+    time_t last; /* when a request last completed */
+};
+
+static void async_start(struct async_ctx *ctx, ne_session *sess);
+
+static void async_done(void *userdata, ne_request *req, int ret)
+{
+    struct async_ctx *ctx = userdata;
+    const ne_request_timing *t = ne_get_request_timing(req);
+    ne_session *sess = ne_get_session(req);
+
+    if (ret == NE_OK && ne_get_status(req)->klass == 2)
+	hist_record(g_hist, t->body_done - t->send_start);
+    else
+	ctx->failed++;
+    ne_request_destroy(req);
+    ctx->last = time(NULL);
+
+    /* keep the connection busy while there is work left. */
+    if (ctx->tostart > 0)
+	async_start(ctx, sess);
+}
+
+static void async_start(struct async_ctx *ctx, ne_session *sess)
+{
+    ne_request *req = ne_template_request(ctx->tpl, ctx->uri);
+
+    ctx->tostart--;
+    if (ne_async_dispatch(ctx->as, req, async_done, ctx) != NE_OK) {
+	ctx->failed++;
+	ne_request_destroy(req);
+    }
+}
+
+/* GET an 'fsize'K resource, with pget_option.async requests in
+ * flight at once, each on a connection of its own from the pool of
+ * one session, all driven from this process by the asynchronous
+ * request engine; reported as 'name'. */
+static int do_async_get(int fsize, char *name)
+{
+    struct async_ctx ctx;
+    ne_session *sess = NULL;
+    char *fn, *uri;
+    int n, fd, nconns = pget_option.async, ret = OK;
+
+    if (nconns < 1)
+	return OK;
+
+    /* before anything is made which would need cleaning up. */
+    if (pget_option.uring) {
+	ctx.as = ne_async_create_ring(nconns);
+	if (ctx.as == NULL) {
+	    t_context("io_uring is not supported here");
+	    return SKIP;
+	}
+    } else {
+	ctx.as = ne_async_create();
+	if (ctx.as == NULL) {
+	    t_context("asynchronous requests are not supported here");
+	    return SKIP;
+	}
+    }
+
+    uri = ne_concat(i_path, "async", NULL);
+    fn = create_temp(test_contents, fsize);
+    fd = open(fn, O_RDONLY | O_BINARY);
+    ret = ne_put(i_session, uri, fd);
+    close(fd);
+    if (ret != NE_OK) {
+	t_context("PUT of `%s' failed: %s", uri, ne_get_error(i_session));
+	ret = FAIL;
+	goto out;
+    }
+
+    sess = open_session();
+    if (sess == NULL) {
+	ret = FAIL;
+	goto out;
+    }
+    ne_set_max_connections(sess, nconns);
+
+    ctx.tpl = ne_template_create(sess, "GET");
+    ctx.uri = uri;
+    ctx.tostart = pget_option.requests;
+    ctx.failed = 0;
+
+    time_begin();
+    ctx.last = time(NULL);
+    for (n = 0; n < nconns && ctx.tostart > 0; n++)
+	async_start(&ctx, sess);
+    while (ne_async_run(ctx.as, 1000) > 0) {
+	if (time(NULL) - ctx.last > TIMEOUT) {
+	    t_context("asynchronous GETs timed out");
+	    ret = FAIL;
+	    break;
+	}
+    }
+    time_process();
+    g_op_bytes = fsize * sizeof(buff);
+    my_printf(name);
+
+    if (ctx.failed) {
+	t_context("%d of %d asynchronous GETs failed", ctx.failed,
+		  pget_option.requests);
+	ret = FAIL;
+    }
+    ne_template_destroy(ctx.tpl);
+
+out:
+    ne_async_destroy(ctx.as);
+    if (sess)
+	ne_session_destroy(sess);
+    ne_delete(i_session, uri);
+    unlink(fn);
+    ne_free(fn);
+    ne_free(uri);
+    return ret;
+}
+
+int async_get1K(void)
+{
+    return do_async_get(1, "AsyncGet1K");
+}
+
+/* With --uring, a few of these in flight outrun the ring's receive
+ * buffers, so the receives must recover once they are read. */
+int async_get1M(void)
+{
+    return do_async_get(1024, "AsyncGet1M");
+}
+
+
+#define PIPE_PROPFIND_BODY \
+"<?xml version=\"1.0\" encoding=\"utf-8\"?>" EOL \
+"<propfind xmlns=\"DAV:\"><allprop/></propfind>" EOL
+
+/* Send pget_option.requests 'method' requests for 'uri' down one
+ * connection, pipelined pget_option.pipeline deep, and report them as
+ * 'name'.  Each response counts from when its request was sent, so
+ * includes any wait behind the responses before it.  PROPFIND
+ * requests are Depth: 0, for all properties. */
+static int do_pipelined(const char *method, const char *uri,
+			const char *name)
+{
+    ne_request_template *tpl = ne_template_create(i_session, method);
+    ne_request **reqs;
+    const ne_request_timing *t;
+    int n, count = pget_option.requests, failed = 0, ret;
+
+    if (strcmp(method, "PROPFIND") == 0) {
+	ne_template_add_header(tpl, "Depth", "0");
+	ne_template_add_header(tpl, "Content-Type", NE_XML_MEDIA_TYPE);
+	ne_template_set_body(tpl, PIPE_PROPFIND_BODY, 
+			     strlen(PIPE_PROPFIND_BODY));
+    }
+
+    reqs = ne_malloc(count * sizeof *reqs);
+    for (n = 0; n < count; n++)
+	reqs[n] = ne_template_request(tpl, uri);
+
+    time_begin();
+    ret = ne_pipeline_dispatch(reqs, count, pget_option.pipeline);
+    for (n = 0; n < count; n++) {
+	t = ne_get_request_timing(reqs[n]);
+	if (ne_get_status(reqs[n])->klass == 2 && t->body_done >= t->send_start)
+	    hist_record(g_hist, t->body_done - t->send_start);
+	else
+	    failed++;
+	ne_request_destroy(reqs[n]);
+    }
+    time_process();
+    my_printf(name);
+    ne_free(reqs);
+    ne_template_destroy(tpl);
+
+    ONV(ret != NE_OK, ("pipelined %s of `%s': %s", method, uri, 
+		       ne_get_error(i_session)));
+    ONV(failed, ("%d of %d pipelined %s requests failed", failed, count,
+		 method));
+    return OK;
+}
+
+/* Small idempotent requests, pipelined so that the round trip time
+ * drops out of the throughput measured. */
+int pipelined(void)
+{
+    char *fn, *uri;
+    int fd, ret;
+
+    if (pget_option.pipeline < 1)
+	return OK;
+
+    uri = ne_concat(i_path, "pipe", NULL);
+    fn = create_temp(test_contents, 1);
+    fd = open(fn, O_RDONLY | O_BINARY);
+    ret = ne_put(i_session, uri, fd);
+    close(fd);
+    unlink(fn);
+    ne_free(fn);
+    ONV(ret, ("PUT of `%s' failed: %s", uri, ne_get_error(i_session)));
+
+    ret = do_pipelined("GET", uri, "PipeGet1K");
+    if (ret == OK)
+	ret = do_pipelined("OPTIONS", i_path, "PipeOptions");
+    if (ret == OK)
+	ret = do_pipelined("PROPFIND", uri, "PipePropfindSingle");
+
+    ne_delete(i_session, uri);
+    ne_free(uri);
+    return ret;
+}
+
 
 int
 my_single(void)
@@ -207,6 +438,7 @@ static int wf_do_put_get(const char *segment, int fsize)
 
     memset(str, 0, sizeof(str));
     sprintf(str, "Put%dK", fsize);
+    g_op_bytes = fsize * sizeof(buff);
     my_printf(str);
 
     close(fd);
@@ -218,6 +450,7 @@ static int wf_do_put_get(const char *segment, int fsize)
     SEND_REQUEST(ne_get(i_session, uri, fd));
     memset(str, 0, sizeof(str));
     sprintf(str, "Get%dK", fsize);
+    g_op_bytes = fsize * sizeof(buff);
     my_printf(str);
  
     close(fd);
@@ -239,6 +472,7 @@ int wf_put_get1K(void)
 int
 wf_my_single(void)
 {
+   ne_request_template *pf;
    char *dest, *dest2, *uri, *uri2, *res;
    ne_server_capabilities caps = {0};
    char tmp[100], buffer[128];
@@ -290,6 +524,9 @@ wf_my_single(void)
     sprintf(tmp, "source");
     propnames[10].name = ne_strdup(tmp);
 
+    /* the PROPFIND each operation starts with. */
+    pf = ne_propfind_template(i_session, NE_DEPTH_ZERO, propnames);
+
 	/* ** */
 
    dest = ne_concat(i_path, "movedest", NULL);
@@ -301,11 +538,9 @@ wf_my_single(void)
    CALL(upload_foo("move"));
 
     /* Mkcol */
-   SEND_REQUEST3_FOUR(ne_simple_propfind(i_session, uri2, NE_DEPTH_ZERO, 
-			propnames,NULL, NULL),
+   SEND_REQUEST3_FOUR(ne_simple_propfind_tpl(pf, uri2, NULL, NULL),
 		ne_mkcol(i_session, uri), 
-    		ne_simple_propfind(i_session, uri, NE_DEPTH_ZERO,
-			propnames, NULL, NULL),
+    		ne_simple_propfind_tpl(pf, uri, NULL, NULL),
 		ne_delete(i_session, uri));
 
    my_printf("MkCol");
@@ -314,8 +549,7 @@ wf_my_single(void)
    uri = ne_concat(i_path, "move", NULL);
 
    /* copy */
-   SEND_REQUEST_TWO(ne_simple_propfind(i_session, dest, NE_DEPTH_ZERO,
-			propnames, NULL, NULL),
+   SEND_REQUEST_TWO(ne_simple_propfind_tpl(pf, dest, NULL, NULL),
 		ne_copy(i_session, 1, NE_DEPTH_INFINITE, uri, dest));
 
    my_printf("Copy");
@@ -323,16 +557,14 @@ wf_my_single(void)
 
    /* move */
    SEND_REQUEST2_THREE(ne_copy(i_session, 1, NE_DEPTH_INFINITE, uri, dest),
-		ne_simple_propfind(i_session, dest2, NE_DEPTH_ZERO,
-			propnames, NULL, NULL),
+		ne_simple_propfind_tpl(pf, dest2, NULL, NULL),
 	       ne_move(i_session, 1, dest, dest2));
 
    my_printf("Move");
 
    /* delete */
    SEND_REQUEST2_THREE(ne_copy(i_session, 1, NE_DEPTH_INFINITE, uri, dest),
-		ne_simple_propfind(i_session, dest, NE_DEPTH_ZERO,
-			propnames, NULL, NULL),
+		ne_simple_propfind_tpl(pf, dest, NULL, NULL),
    		ne_delete(i_session, dest));
 
    my_printf("Delete");
@@ -383,10 +615,10 @@ wf_my_single(void)
 		ne_options(i_session, i_path, &caps),
 		ne_get(i_session, str1, fd),
 		ne_post(i_session, str2, fd, buffer),
-		ne_simple_propfind(i_session, i_path, NE_DEPTH_ZERO,
-			propnames, NULL, NULL)
+		ne_simple_propfind_tpl(pf, i_path, NULL, NULL)
 		);
 
    my_printf("Mount");
+   ne_template_destroy(pf);
 } 
 
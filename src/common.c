@@ -1,6 +1,7 @@
 
 #include <sys/types.h>
 #include <sys/time.h>
+#include <time.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <fcntl.h>
@@ -8,6 +9,8 @@
 #include <sys/wait.h>
 #include <signal.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <pthread.h>
 #include <config.h>
 #include <ne_props.h>
 
@@ -16,6 +19,7 @@
 #endif
 #include <ne_uri.h>
 #include <ne_auth.h>
+#include <ne_string.h>
 
 #ifdef HAVE_STRING_H
 #include <string.h>
@@ -29,22 +33,68 @@
 
 extern int proppatch(void);
 
-int g_echo = 1;
+PER_WORKER int g_echo = 1;
 int l_msize;
 char *l_p;
 
 int numprops, removedprops;
-extern struct timeval g_tv1, g_tv2;
 
 int i_class2 = 0;
 
 volatile int *g_intp;
-ne_session *i_session, *i_session2, *tmp_session;
+PER_WORKER ne_session *i_session, *i_session2, *tmp_session;
 
 const char *i_hostname;
 int i_port;
 ne_sock_addr *i_address;
-char *i_path;
+PER_WORKER char *i_path;
+
+PER_WORKER float g_average, g_std_variance, g_ops, g_cpu;
+PER_WORKER double g_op_bytes;
+static PER_WORKER double g_cpu_start;
+PER_WORKER histogram_t *g_hist;
+
+/* The --phases breakdown: g_phases holds a histogram for each phase,
+ * filled from the timing of each request and the times at which the
+ * session reported the steps of setting up its connection. */
+enum { PH_DNS, PH_CONNECT, PH_TLS, PH_SEND, PH_TTFB, PH_RECV };
+static const char *const phase_names[NPHASES] = {
+    "DNS", "Connect", "TLS", "Send", "TTFB", "Recv"
+};
+static PER_WORKER histogram_t *g_phases;
+static PER_WORKER ne_hrtime ph_lookup, ph_secure;
+
+/* time taken by each connection opened in the measured loop. */
+static PER_WORKER histogram_t *g_connect;
+
+/* The counts summed over the measured loop, for --syscalls. */
+enum { CNT_REQUESTS, CNT_READS, CNT_WRITES, CNT_WAITS, CNT_SEGMENTS,
+       CNT_FAILURES };
+static PER_WORKER double g_counts[NCOUNTS];
+/* set when a request of the sample in progress failed */
+static PER_WORKER int g_sample_failed;
+/* the send_start of the timing req_elapsed saw last */
+static PER_WORKER ne_hrtime g_last_send;
+/* workers whose results went into the last measurement */
+static PER_WORKER int g_merged;
+
+/* Create the histograms of this worker. */
+static void hists_create(void)
+{
+    g_hist = hist_create();
+    g_connect = hist_create();
+    if (pget_option.phases)
+	g_phases = ne_calloc(NPHASES * sizeof(histogram_t));
+}
+
+static void hists_destroy(void)
+{
+    hist_destroy(g_hist);
+    hist_destroy(g_connect);
+    if (g_phases)
+	ne_free(g_phases);
+    g_phases = NULL;
+}
 
 static int use_secure = 0;
 
@@ -55,7 +105,7 @@ static char *htdocs_root = NULL;
 static char *proxy_hostname = NULL;
 static int proxy_port;
 
-int i_foo_fd;
+PER_WORKER int i_foo_fd;
 
 
 static char dots[] = "...................";
@@ -78,26 +128,33 @@ const static struct option longopts[] = {
 #define MAXCHILD 256
 pid_t childpid[MAXCHILD];
 
-int time_comp(const void *t1, const void *t2)
-{
-    return (*(float*)t1 > *(float*)t2);
-}
+/* the threaded mode can run many more workers than it is sensible to
+ * fork; each gets a smaller stack than the default. */
+#define MAXTHREADS 4096
+#define THREAD_STACK (256 * 1024)
+static pthread_t *threads;
 
-/* Return: number of valid elements */
-int time_filter(float a[], float b[], int nelm, float median, float percentage)
-{
-    int i, j;
-    float bound;
+/* number of workers actually started, including worker 0. */
+static int nstarted = 1;
 
-    bound = median * percentage;
-    for( i=j=0; i<nelm; i++){
-	if ( abs((int)(a[i]-median))< bound){
-	    b[j] = a[i];
-	    j++;	
-	}
-    }
-    return j;
-}
+/* tests to run, and the one which started the workers: the threads
+ * of the threaded mode carry on from the test after it. */
+static ne_test *g_tests;
+static int spawn_test;
+
+PER_WORKER int g_worker = 0, g_nworkers = 1;
+
+/* collection all the workers live under; each one gets its own. */
+static char *i_root_path;
+
+static PER_WORKER ne_hrtime g_tstart;
+
+/* the rate mode (--rate): when the next operation is due to start,
+ * and the seed for Poisson arrivals. */
+static PER_WORKER ne_hrtime g_next;
+static PER_WORKER unsigned short g_seed[3] = { 0x1234, 0x5678, 0x9abc };
+
+static int run_tests(int first);
 
 static int open_foo(void)
 {
@@ -118,7 +175,8 @@ static int test_connect(void)
 
     for (ia = ne_addr_first(i_address); ia && !sock; 
 	 ia = ne_addr_next(i_address))
-	sock = ne_sock_connect(ia, port);
+	sock = ne_sock_connect_ms(ia, port, pget_option.ctimeout 
+				  ? pget_option.ctimeout : -1);
     
     if (sock == NULL) {
 	t_context("connection refused by `%s' port %d",
@@ -131,7 +189,9 @@ static int test_connect(void)
 
 static int test_resolve(const char *hostname, const char *name)
 {
-    i_address = ne_addr_resolve(hostname, 0);
+    /* the sessions opened later find the result in the cache. */
+    ne_addr_cache_ttl(pget_option.dns_ttl);
+    i_address = ne_addr_resolve_cached(hostname, pget_option.family);
     if (ne_addr_result(i_address)) {
 	char buf[256];
 	t_context("%s hostname `%s' lookup failed: %s", name, hostname,
@@ -141,6 +201,18 @@ static int test_resolve(const char *hostname, const char *name)
     return OK;
 }
 
+/* Let this process open as many descriptors as it may: the threaded
+ * and asynchronous modes need one for each connection. */
+static void raise_fd_limit(void)
+{
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+	rl.rlim_cur = rl.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
 int init(void)
 {
     ne_uri u = {0}, proxy = {0};
@@ -150,15 +222,9 @@ int init(void)
     int i;
 
 
-    if ((times1=malloc(sizeof(float)*pget_option.requests)) == NULL){
-	perror("malloc(times1) :");
-	exit(-1);
-    }	
-    if ((times2=malloc(sizeof(float)*pget_option.requests)) == NULL){
-	perror("malloc(times2) :");
-	exit(-1);
-    }	
-	
+    hists_create();
+    raise_fd_limit();
+
     while ((optc = getopt_long(test_argc, test_argv, 
 			       "d:hp", longopts, NULL)) != -1) {
 	switch (optc) {
@@ -285,7 +351,7 @@ static int init_session(ne_session *sess)
 	ne_session_proxy(sess, proxy_hostname, proxy_port);
     }
 
-    ne_set_useragent(i_session, "davtest/" PACKAGE_VERSION);
+    ne_set_useragent(sess, "davtest/" PACKAGE_VERSION);
 
     if (i_username) {
 	ne_set_server_auth(sess, auth, NULL);
@@ -303,11 +369,102 @@ static int init_session(ne_session *sess)
     return OK;
 }    
 
+/* Status callback for --phases: notes when each connect step began. */
+static void phase_notify(void *userdata, ne_conn_status status,
+			 const char *info)
+{
+    ne_hrtime now = ne_hrtime_now();
+
+    switch (status) {
+    case ne_conn_namelookup: ph_lookup = now; break;
+    case ne_conn_secure: ph_secure = now; break;
+    default: break;
+    }
+}
+
+/* Split the request with timing 't' into its phases.  The DNS lookup
+ * happens before the request starts, and is not part of its latency;
+ * the connect and TLS handshake only count if the request opened the
+ * connection it was sent on.  Phases which did not happen are not
+ * recorded, so each has its own count. */
+static void phase_record(const ne_request_timing *t)
+{
+    ne_hrtime ready = t->send_start;
+
+    if (ph_lookup && ph_lookup <= t->send_start)
+	hist_record(&g_phases[PH_DNS], t->send_start - ph_lookup);
+    if (t->connected) {
+	hist_record(&g_phases[PH_CONNECT], t->connected - t->connect_start);
+	ready = t->connected;
+	if (ph_secure >= t->connected) {
+	    hist_record(&g_phases[PH_TLS], ph_secure - t->connected);
+	    ready = ph_secure;
+	}
+    }
+    if (t->send_done >= ready)
+	hist_record(&g_phases[PH_SEND], t->send_done - ready);
+    if (t->send_done && t->first_byte >= t->send_done)
+	hist_record(&g_phases[PH_TTFB], t->first_byte - t->send_done);
+    if (t->first_byte && t->body_done >= t->first_byte)
+	hist_record(&g_phases[PH_RECV], t->body_done - t->first_byte);
+
+    ph_lookup = ph_secure = 0;
+}
+
+/* Print the distribution of each phase seen in the loop just run. */
+static void phase_report(void)
+{
+    const histogram_t *h;
+    int n;
+
+    for (n = 0; n < NPHASES; n++) {
+	h = &g_phases[n];
+	if (h->count == 0)
+	    continue;
+	printf("%*s %-8s n = %-7lu mean = %.0f  p50 = %.0f  p99 = %.0f"
+	       "  max = %.0f [us]\n", 30, "", phase_names[n], h->count,
+	       hist_mean(h) / 1000, hist_percentile(h, 50) / 1000.0,
+	       hist_percentile(h, 99) / 1000.0, h->max / 1000.0);
+    }
+}
+
+/* Returns a new session to the server under test, set up like
+ * i_session, or NULL (with the test context set) on failure. */
+ne_session *open_session(void)
+{
+    const char *scheme = use_secure?"https":"http";
+    ne_session *sess = ne_session_create(scheme, i_hostname, i_port);
+
+    if (init_session(sess) != OK) {
+	ne_session_destroy(sess);
+	return NULL;
+    }
+    ne_hook_pre_send(sess, i_pre_send, "X-Prestan");
+    if (pget_option.phases)
+	ne_set_status(sess, phase_notify, NULL);
+    if (pget_option.rdbuf)
+	ne_set_read_buffer(sess, pget_option.rdbuf);
+    if (pget_option.timeout)
+	ne_set_read_timeout_ms(sess, pget_option.timeout);
+    if (pget_option.ctimeout)
+	ne_set_connect_timeout_ms(sess, pget_option.ctimeout);
+    if (pget_option.race)
+	ne_set_connect_race(sess, 1);
+    if (pget_option.family)
+	ne_set_addr_flags(sess, pget_option.family);
+    if (pget_option.nagle)
+	ne_set_nodelay(sess, 0);
+    if (pget_option.cork)
+	ne_set_cork(sess, 1);
+    return sess;
+}
+
 int warmup(void)
 {
     char str[64], *src;
     struct timeval start, cur;
-    int old_requests;
+    int old_requests, old_ramp;
+    double old_rate;
 
 	g_echo = 0;
 
@@ -324,6 +481,10 @@ int warmup(void)
 	gettimeofday(&cur, NULL);
 	old_requests = pget_option.requests;
 	pget_option.requests = 10;
+	old_rate = pget_option.rate;
+	pget_option.rate = 0;
+	old_ramp = pget_option.ramp;
+	pget_option.ramp = 0;
 	while ( (cur.tv_sec - start.tv_sec) < WARMUP_TIME){
 
 		proppatch();
@@ -340,22 +501,22 @@ int warmup(void)
 	}
 
 	pget_option.requests = old_requests;
+	pget_option.rate = old_rate;
+	pget_option.ramp = old_ramp;
 	printf("Done\n");
 	g_echo = 1;
 }
 
 int begin(void)
 {
-    const char *scheme = use_secure?"https":"http";
     char *space;
     static const char blanks[] = "          ";
     static const char stars[] = "**********************************";
     
 
-    i_session = ne_session_create(scheme, i_hostname, i_port);
-    CALL(init_session(i_session));
-    ne_hook_pre_send(i_session, i_pre_send, "X-Prestan");
-
+    i_session = open_session();
+    if (i_session == NULL)
+	return FAILHARD;
 
     space = ne_concat(i_path, "davtest/", NULL);
     ne_delete(i_session, space);
@@ -378,14 +539,678 @@ int begin(void)
     printf("\n%s* Depth of Collection\t\t%d\n", blanks, pget_option.depth);
     printf("\n%s* Width of Collection\t\t%d\n", blanks, pget_option.width);
     printf("\n%s* Type of Methods\t\t%s\n", blanks, pget_option.methods);
+    printf("\n%s* Concurrency\t\t\t%d%s\n", blanks, pget_option.concurrency,
+	   pget_option.threads ? " threads" : "");
+    if (pget_option.async > 0)
+	printf("\n%s* Asynchronous Requests\t%d%s\n", blanks, pget_option.async,
+	       pget_option.uring ? " (io_uring)" : "");
+    if (pget_option.pipeline > 0)
+	printf("\n%s* Pipeline Depth\t\t%d\n", blanks, pget_option.pipeline);
+    if (pget_option.ctimeout || pget_option.race)
+	printf("\n%s* Connect\t\t\t%s%s%.0d%s\n", blanks,
+	       pget_option.race ? "racing addresses" : "",
+	       pget_option.race && pget_option.ctimeout ? ", " : "",
+	       pget_option.ctimeout, pget_option.ctimeout ? " ms timeout" : "");
+    if (pget_option.family)
+	printf("\n%s* Address Family\t\tIPv%d\n", blanks,
+	       pget_option.family == NE_ADDR_IPV4 ? 4 : 6);
+    if (pget_option.nagle || pget_option.cork)
+	printf("\n%s* TCP Writes\t\t\t%s%s%s\n", blanks,
+	       pget_option.nagle ? "Nagle" : "",
+	       pget_option.nagle && pget_option.cork ? ", " : "",
+	       pget_option.cork ? "corked" : "");
+    if (pget_option.rdbuf)
+	printf("\n%s* Read Buffer\t\t\t%lu bytes\n", blanks, 
+	       (unsigned long)pget_option.rdbuf);
+    if (pget_option.sink)
+	printf("\n%s* GET Body Sink\t\t\t%s\n", blanks, 
+	       pget_option.sink == SINK_NULL ? "null" : "file");
+    if (pget_option.nlistings > 0) {
+	int n;
+	printf("\n%s* Listing Widths\t\t", blanks);
+	for (n = 0; n < pget_option.nlistings; n++)
+	    printf("%s%d", n ? ", " : "", pget_option.listing[n]);
+	printf("\n");
+    }
+    if (pget_option.bigpatch)
+	printf("\n%s* Streamed PROPPATCH\t\t%d x %lu bytes\n", blanks,
+	       pget_option.bigpatch, (unsigned long)pget_option.bigpatch_size);
+    if (pget_option.discard)
+	printf("\n%s* PROPFIND Bodies\t\t%s\n", blanks, 
+	       pget_option.discard == DISCARD_ON ? "drained" 
+	       : "parsed, then drained");
+    if (pget_option.phases)
+	printf("\n%s* Phase Breakdown\t\tDNS, Connect, TLS, Send, TTFB, Recv\n",
+	       blanks);
+    if (pget_option.rate > 0)
+	printf("\n%s* Target Rate\t\t\t%.1f/s (%s)\n", blanks, 
+	       pget_option.rate, pget_option.poisson ? "Poisson" : "fixed");
+    if (pget_option.ramp == RAMP_USERS)
+	printf("\n%s* Ramp\t\t\t\t1 to %d users, %ds steps\n", blanks,
+	       pget_option.concurrency, pget_option.step_time);
+    else if (pget_option.ramp == RAMP_RATE)
+	printf("\n%s* Ramp\t\t\t\t+%.1f/s, %ds steps\n", blanks,
+	       pget_option.ramp_rate, pget_option.step_time);
     printf("\n%s%s\n", blanks, stars);
     printf("\n\n");
     
+    return spawn_workers();
+}
+
+/* Set up the worker just started: it needs a session and a
+ * collection of its own. */
+static int worker_setup(void)
+{
+    char buf[32];
+
+    /* vary the Poisson arrivals from one worker to the next. */
+    g_seed[2] += g_worker;
+
+    if (g_worker != 0) {
+	if (!pget_option.threads) {
+	    ne_session_destroy(i_session);
+	    /* the file offset of i_foo_fd is shared with the parent. */
+	    close(i_foo_fd);
+	}
+	i_session = open_session();
+	if (i_session == NULL)
+	    return FAILHARD;
+	CALL(open_foo());
+    }
+
+    ne_snprintf(buf, sizeof buf, "w%d/", g_worker);
+    i_path = ne_concat(i_root_path, buf, NULL);
+    if (ne_mkcol(i_session, i_path)) {
+	t_context("Could not create worker collection `%s': %s",
+		  i_path, ne_get_error(i_session));
+	return FAILHARD;
+    }
+
     return OK;
 }
 
+/* Body of a worker thread: runs the rest of the tests, from the one
+ * after that which started the workers, up to finish(). */
+static void *worker_thread(void *arg)
+{
+    g_worker = (long)arg;
+    g_nworkers = pget_option.concurrency;
+    g_echo = 0;
+    hists_create();
+
+    if (worker_setup() != OK) {
+	printf("WARNING: worker %d could not start: %s\n",
+	       g_worker, test_context);
+	g_sharep->pause[g_worker] = 1;
+	if (i_session)
+	    ne_session_destroy(i_session);
+	hists_destroy();
+	return NULL;
+    }
+
+    run_tests(spawn_test + 1);
+    return NULL;
+}
+
+/* Start the extra workers for the concurrency modes: processes (-c)
+ * or threads (-t).  Every worker, including this process as worker 0,
+ * then runs the rest of the tests with a session and a collection of
+ * its own, meeting the others in the shared segment around each
+ * measurement. */
+int spawn_workers(void)
+{
+    int n, nw = pget_option.concurrency;
+    int max = pget_option.threads ? MAXTHREADS : MAXCHILD;
+    size_t size;
+    char *seg;
+    pid_t pid;
+
+    i_root_path = i_path;
+
+    if (nw < 2)
+	return OK;
+
+    if (nw > max) {
+	printf("Concurrency limited to %d workers\n", max);
+	nw = pget_option.concurrency = max;
+    }
+
+    size = sizeof(process_share_t) + nw * sizeof(histogram_t)
+	+ (pget_option.phases ? nw * NPHASES * sizeof(histogram_t) : 0)
+	+ nw * sizeof(histogram_t)
+	+ nw * NCOUNTS * sizeof(double)
+	+ 2 * nw * sizeof(float) + nw * sizeof(short);
+    seg = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (seg == MAP_FAILED) {
+	t_context("could not map shared segment: %s", strerror(errno));
+	return FAILHARD;
+    }
+    g_sharep = (process_share_t *)seg;
+    g_sharep->hists = (histogram_t *)(seg + sizeof(process_share_t));
+    g_sharep->phase_hists = g_sharep->hists + nw;
+    g_sharep->connect_hists = g_sharep->phase_hists
+	+ (pget_option.phases ? nw * NPHASES : 0);
+    g_sharep->counts = (double *)(g_sharep->connect_hists + nw);
+    g_sharep->rstlist2 = (float *)(g_sharep->counts + nw * NCOUNTS);
+    g_sharep->cpulist = g_sharep->rstlist2 + nw;
+    g_sharep->pause = (short *)(g_sharep->cpulist + nw);
+
+    g_nworkers = nw;
+
+    if (pget_option.threads) {
+	pthread_attr_t attr;
+	int ret;
+
+	spawn_test = test_num;
+	threads = ne_calloc(nw * sizeof *threads);
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, THREAD_STACK);
+	for (n = 1; n < nw; n++) {
+	    ret = pthread_create(&threads[n], &attr, worker_thread,
+				 (void *)(long)n);
+	    if (ret) {
+		printf("pthread_create() : %s\n", strerror(ret));
+		/* carry on with the workers we have got. */
+		for (; n < nw; n++)
+		    g_sharep->pause[n] = 1;
+		break;
+	    }
+	    nstarted++;
+	}
+	pthread_attr_destroy(&attr);
+	return worker_setup();
+    }
+
+    /* The children must not inherit the connection (or buffered
+     * output) of the parent. */
+    ne_close_connection(i_session);
+    fflush(stdout);
+
+    for (n = 1; n < nw; n++) {
+	pid = fork();
+	if (pid < 0) {
+	    perror("fork() :");
+	    /* carry on with the workers we have got. */
+	    for (; n < nw; n++)
+		g_sharep->pause[n] = 1;
+	    break;
+	} else if (pid == 0) {
+	    g_worker = n;
+	    g_echo = 0;
+	    break;
+	}
+	childpid[n] = pid;
+	nstarted++;
+    }
+
+    return worker_setup();
+}
+
+/* Open barrier 'gen' if every worker still taking part has arrived
+ * at it; returns non-zero if this worker opened it.  The count is
+ * taken afresh each time, as a worker may drop out while the others
+ * wait for it. */
+static int barrier_open(int gen)
+{
+    int n, count, active = 0;
+
+    for (n = 0; n < pget_option.concurrency; n++)
+	if (!g_sharep->pause[n])
+	    active++;
+
+    count = g_sharep->synccnt;
+    if (count < active
+	|| !__sync_bool_compare_and_swap(&g_sharep->synccnt, count, 0))
+	return 0;
+    __sync_synchronize();
+    g_sharep->generation = gen + 1;
+    return 1;
+}
+
+/* Take this worker's arrival back from barrier 'gen', unless it has
+ * opened meanwhile, when the count is already reset and the worker
+ * has got through; returns non-zero if the arrival was taken back.
+ * Whilst the barrier is shut the count includes this worker, so one
+ * below that means it has been opened, if generation is yet to show
+ * it. */
+static int barrier_leave(int gen)
+{
+    int count;
+
+    for (;;) {
+	count = g_sharep->synccnt;
+	if (count < 1 || g_sharep->generation != gen)
+	    return 0;
+	if (__sync_bool_compare_and_swap(&g_sharep->synccnt, count, 
+					 count - 1))
+	    return 1;
+    }
+}
+
+/* Wait until all the workers still taking part have arrived.  A
+ * worker left waiting for more than TIMEOUT seconds gives up on the
+ * others and carries on measuring alone. */
+static void worker_barrier(void)
+{
+    struct timeval start, cur;
+    int gen;
+
+    if (g_nworkers < 2)
+	return;
+
+    gen = g_sharep->generation;
+    __sync_add_and_fetch(&g_sharep->synccnt, 1);
+    if (barrier_open(gen))
+	return;
+
+    gettimeofday(&start, NULL);
+    while (g_sharep->generation == gen && !barrier_open(gen)) {
+	usleep(50);
+	gettimeofday(&cur, NULL);
+	if (cur.tv_sec - start.tv_sec > TIMEOUT && barrier_leave(gen)) {
+	    printf("WARNING: worker %d gave up waiting for the others.\n",
+		   g_worker);
+	    g_sharep->pause[g_worker] = 1;
+	    g_nworkers = 1;
+	    return;
+	}
+    }
+}
+
+/* Take this worker out of the measurements for good, after one of
+ * its tests failed: it may have left the test without reaching the
+ * barriers the others will wait at, so they stop counting it at
+ * once, and it measures alone from now on. */
+static void worker_drop(const char *name)
+{
+    if (g_nworkers < 2)
+	return;
+
+    printf("WARNING: worker %d failed %s, and drops out.\n", g_worker, name);
+    g_sharep->pause[g_worker] = 1;
+    __sync_synchronize();
+    g_nworkers = 1;
+}
+
+/* CPU time used by this worker so far [s]. */
+static double cpu_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(pget_option.threads ? CLOCK_THREAD_CPUTIME_ID 
+		  : CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Start of a measured loop: line up all the workers first. */
+void time_begin(void)
+{
+    int n;
+
+    hist_reset(g_hist);
+    hist_reset(g_connect);
+    for (n = 0; pget_option.phases && n < NPHASES; n++)
+	hist_reset(&g_phases[n]);
+    memset(g_counts, 0, sizeof g_counts);
+    g_sample_failed = 0;
+    worker_barrier();
+    g_next = g_tstart = ne_hrtime_now();
+    g_cpu_start = cpu_time();
+}
+
+/* The ramp mode (--ramp).  g_load is the load of the step in
+ * progress: the number of workers taking part (RAMP_USERS), or the
+ * target rate (RAMP_RATE); it is 0 once the ramp is over, and outside
+ * the measured loops.  Worker 0 alone decides when to move on to the
+ * next step, and keeps the results of each for the report. */
+static PER_WORKER double g_load;
+static PER_WORKER int g_pass;
+
+/* A step is measured again and again, in windows of step_time
+ * seconds, until the throughput and mean latency of one window are
+ * both within RAMP_STABLE of those of the window before, or for
+ * RAMP_MAXWINDOWS windows at most. */
+#define RAMP_STABLE 0.05
+#define RAMP_MAXWINDOWS 5
+#define RAMP_MAXSTEPS 64
+/* the rate ramp stops once the server manages less than this
+ * fraction of the target rate. */
+#define RAMP_SATURATED 0.9
+/* a step counts as sustainable if its mean latency is no more than
+ * this multiple of that at the knee. */
+#define RAMP_SUSTAINABLE 2.0
+
+struct ramp_row {
+    double load;		/* workers, or target rate [ops/s] */
+    double thr;			/* [ops/s] */
+    double mean, p50, p99;	/* [us] */
+    int stable;			/* settled before RAMP_MAXWINDOWS */
+};
+
+static struct ramp_row ramp_rows[RAMP_MAXSTEPS];
+static int ramp_nrows, ramp_windows;
+static double ramp_last_thr, ramp_last_mean;
+
+/* what was found for each operation, for the summary at the end. */
+#define RAMP_MAXOPS 64
+static struct {
+    char name[32];
+    struct ramp_row knee;
+    double max_thr;		/* max sustainable rate [ops/s] */
+} ramp_ops[RAMP_MAXOPS];
+static int ramp_nops;
+
+void ramp_begin(void)
+{
+    g_pass = 0;
+    if (!pget_option.ramp)
+	return;
+
+    /* a worker which has dropped out measures alone, and must stay
+     * out of the ramp which worker 0 keeps. */
+    if (g_worker != 0 && g_nworkers < 2) {
+	g_load = 0;
+	return;
+    }
+    g_load = pget_option.ramp == RAMP_USERS ? 1 : pget_option.ramp_rate;
+    if (g_worker == 0)
+	ramp_nrows = ramp_windows = 0;
+}
+
+int ramp_step(void)
+{
+    if (!pget_option.ramp)
+	return g_pass++ == 0;
+    return g_load > 0;
+}
+
+int loop_more(int i)
+{
+    if (g_load == 0)
+	return i < pget_option.requests;
+    if (pget_option.ramp == RAMP_USERS && g_worker >= g_load)
+	return 0;
+    return ne_hrtime_now() - g_tstart
+	< pget_option.step_time * (ne_hrtime)1000000000;
+}
+
+/* Number of workers taking part in the loop in progress. */
+static int active_workers(void)
+{
+    if (pget_option.ramp == RAMP_USERS && g_load > 0 && g_load < g_nworkers)
+	return g_load;
+    return g_nworkers;
+}
+
+/* Target rate of the loop in progress [ops/s], or 0 for none. */
+static double target_rate(void)
+{
+    if (pget_option.ramp == RAMP_RATE && g_load > 0)
+	return g_load;
+    return pget_option.rate;
+}
+
+/* Called by worker 0 at the end of each window of a ramp step, with
+ * the merged results in g_hist and g_ops.  Returns the load of the
+ * next window: the same again until the figures settle, then that of
+ * the next step, or 0 once the ramp is over. */
+static double ramp_decide(void)
+{
+    struct ramp_row *row;
+    double thr = g_ops, mean = hist_mean(g_hist) / 1000;
+    int stable;
+
+    stable = ramp_windows > 0
+	&& fabs(thr - ramp_last_thr) <= RAMP_STABLE * ramp_last_thr
+	&& fabs(mean - ramp_last_mean) <= RAMP_STABLE * ramp_last_mean;
+    ramp_last_thr = thr;
+    ramp_last_mean = mean;
+    if (!stable && ++ramp_windows < RAMP_MAXWINDOWS)
+	return g_load;
+    ramp_windows = 0;
+
+    row = &ramp_rows[ramp_nrows++];
+    row->load = g_load;
+    row->thr = thr;
+    row->mean = mean;
+    row->p50 = hist_percentile(g_hist, 50) / 1000.0;
+    row->p99 = hist_percentile(g_hist, 99) / 1000.0;
+    row->stable = stable;
+
+    if (ramp_nrows == RAMP_MAXSTEPS)
+	return 0;
+
+    if (pget_option.ramp == RAMP_USERS) {
+	if (g_load >= g_nworkers)
+	    return 0;
+	return g_load * 2 < g_nworkers ? g_load * 2 : g_nworkers;
+    }
+
+    /* stop past saturation, or at the ceiling given by -R. */
+    if (thr < RAMP_SATURATED * g_load)
+	return 0;
+    if (pget_option.rate > 0
+	&& g_load + pget_option.ramp_rate > pget_option.rate)
+	return 0;
+    return g_load + pget_option.ramp_rate;
+}
+
+/* Throughput for the latency: the knee of the curve is where this
+ * peaks. */
+static double ramp_power(const struct ramp_row *row)
+{
+    return row->mean > 0 ? row->thr / row->mean : 0;
+}
+
+/* Print the table of the steps of the ramp just run for operation
+ * 'name', with the knee and the max sustainable rate found. */
+static void ramp_report(const char *name)
+{
+    struct ramp_row *row, *knee = &ramp_rows[0];
+    double max_thr = 0;
+    int n, users = pget_option.ramp == RAMP_USERS;
+
+    printf("\n%s\n", name);
+    printf("%*s%8s %12s %10s %10s %10s\n", 4, "", users ? "Users" : "Target",
+	   "Thr [ops/s]", "Rsp [us]", "p50 [us]", "p99 [us]");
+    for (n = 0; n < ramp_nrows; n++) {
+	row = &ramp_rows[n];
+	printf("%*s%8.*f %12.1f %10.0f %10.0f %10.0f%s\n", 4, "",
+	       users ? 0 : 1, row->load, row->thr, row->mean,
+	       row->p50, row->p99, row->stable ? "" : "  (unsettled)");
+	if (ramp_power(row) > ramp_power(knee))
+	    knee = row;
+    }
+
+    for (n = 0; n < ramp_nrows; n++) {
+	row = &ramp_rows[n];
+	if (row->mean > RAMP_SUSTAINABLE * knee->mean)
+	    continue;
+	if (!users && row->thr < RAMP_SATURATED * row->load)
+	    continue;
+	if (row->thr > max_thr)
+	    max_thr = row->thr;
+    }
+
+    printf("%*sknee at %.*f %s: Thr = %.1f [ops/s]  Rsp = %.0f [us]; "
+	   "max sustainable %.1f [ops/s]\n", 4, "", users ? 0 : 1,
+	   knee->load, users ? "users" : "[ops/s]", knee->thr, knee->mean,
+	   max_thr);
+
+    if (ramp_nops < RAMP_MAXOPS) {
+	ne_strnzcpy(ramp_ops[ramp_nops].name, name, 
+		    sizeof ramp_ops[ramp_nops].name);
+	ramp_ops[ramp_nops].knee = *knee;
+	ramp_ops[ramp_nops].max_thr = max_thr;
+	ramp_nops++;
+    }
+    ramp_nrows = 0;
+}
+
+/* Print the knee and max sustainable rate of every operation. */
+static void ramp_summary(void)
+{
+    char tmp[64];
+    int n, len, users = pget_option.ramp == RAMP_USERS;
+
+    if (ramp_nops == 0)
+	return;
+
+    printf("\n\nSaturation (knee at, max sustainable rate):\n");
+    for (n = 0; n < ramp_nops; n++) {
+	/* the name, dotted out to 30 columns. */
+	ne_strnzcpy(tmp, ramp_ops[n].name, sizeof tmp);
+	for (len = strlen(tmp); len < 30; len++)
+	    tmp[len] = '.';
+	tmp[len] = '\0';
+	printf("\n%s %.*f %s  Thr = %.1f [ops/s]  Max = %.1f [ops/s]\n",
+	       tmp, users ? 0 : 1, ramp_ops[n].knee.load,
+	       users ? "users" : "[ops/s]", ramp_ops[n].knee.thr,
+	       ramp_ops[n].max_thr);
+    }
+}
+
+/* In the rate mode, operations are started on a schedule fixed in
+ * advance, whether or not the server keeps up: wait until the next
+ * one is due.  Returns how late [ns] it is starting, to be added to
+ * its latency, so that a stall of the server is charged to every
+ * operation it held up ("coordinated omission"), not just the one
+ * caught in it.  Returns 0 straight away outside the rate mode. */
+ne_hrtime rate_wait(void)
+{
+    ne_hrtime now, due = g_next;
+    double gap, rate = target_rate();
+
+    if (rate <= 0)
+	return 0;
+
+    /* each worker takes its share of the target rate. */
+    gap = active_workers() / rate;
+    if (pget_option.poisson)
+	gap *= -log(1.0 - erand48(g_seed));
+    g_next += (ne_hrtime)(gap * 1e9);
+
+    now = ne_hrtime_now();
+    if (now < due) {
+	struct timespec ts;
+	ts.tv_sec = (due - now) / 1000000000;
+	ts.tv_nsec = (due - now) % 1000000000;
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+	    /* nothing */;
+	return 0;
+    }
+    return now - due;
+}
+
+/* End of a measured loop: publish this worker's histogram, and have
+ * worker 0 merge everybody's into its own.  Also works out the
+ * aggregate throughput in g_ops. */
+static void time_merge(void)
+{
+    float elapsed;
+    int n;
+
+    elapsed = (ne_hrtime_now() - g_tstart) / 1000.0;
+    g_cpu = cpu_time() - g_cpu_start;
+
+    if (g_nworkers < 2) {
+	g_merged = 1;
+	g_ops = elapsed > 0 ? g_hist->count / (elapsed / 1000000) : 0;
+	/* the ramp's table is worker 0's alone: one which has dropped
+	 * out leaves the ramp instead. */
+	if (g_load > 0)
+	    g_load = g_worker == 0 ? ramp_decide() : 0;
+	return;
+    }
+
+    memcpy(&g_sharep->hists[g_worker], g_hist, sizeof(histogram_t));
+    memcpy(&g_sharep->connect_hists[g_worker], g_connect, sizeof(histogram_t));
+    if (pget_option.phases)
+	memcpy(&g_sharep->phase_hists[g_worker * NPHASES], g_phases, 
+	       NPHASES * sizeof(histogram_t));
+    g_sharep->rstlist2[g_worker] = elapsed;
+    g_sharep->cpulist[g_worker] = g_cpu;
+    memcpy(&g_sharep->counts[g_worker * NCOUNTS], g_counts, sizeof g_counts);
+    worker_barrier();
+
+    if (g_worker == 0) {
+	hist_reset(g_hist);
+	hist_reset(g_connect);
+	for (n = 0; pget_option.phases && n < NPHASES; n++)
+	    hist_reset(&g_phases[n]);
+	memset(g_counts, 0, sizeof g_counts);
+	g_merged = 0;
+	for (n = 0, elapsed = 0, g_cpu = 0; n < g_nworkers; n++) {
+	    int c;
+
+	    if (g_sharep->pause[n])
+		continue;
+	    g_merged++;
+	    g_cpu += g_sharep->cpulist[n];
+	    for (c = 0; c < NCOUNTS; c++)
+		g_counts[c] += g_sharep->counts[n * NCOUNTS + c];
+	    hist_merge(g_hist, &g_sharep->hists[n]);
+	    hist_merge(g_connect, &g_sharep->connect_hists[n]);
+	    if (pget_option.phases) {
+		int p;
+		for (p = 0; p < NPHASES; p++)
+		    hist_merge(&g_phases[p], 
+			       &g_sharep->phase_hists[n * NPHASES + p]);
+	    }
+	    if (g_sharep->rstlist2[n] > elapsed)
+		elapsed = g_sharep->rstlist2[n];
+	}
+	g_ops = elapsed > 0 ? g_hist->count / (elapsed / 1000000) : 0;
+	if (g_load > 0)
+	    g_sharep->ramp_load = ramp_decide();
+    }
+
+    /* nobody may reuse hists until worker 0 has read them. */
+    worker_barrier();
+
+    /* nobody decides the steps once worker 0 has dropped out. */
+    if (g_load > 0)
+	g_load = g_sharep->pause[0] ? 0 : g_sharep->ramp_load;
+}
+
+/* Reduce the latencies recorded by the measured loop to
+ * g_average/g_std_variance [us], merging those of all the workers
+ * first if there are several. */
+void time_process(void)
+{
+    time_merge();
+    g_average = hist_mean(g_hist) / 1000;
+    g_std_variance = hist_stddev(g_hist) / 1000;
+}
+
 int finish(void)
 {
+    int n;
+
+    if (i_path != i_root_path) {
+	ne_delete(i_session, i_path);
+	if (g_worker != 0) {
+	    ne_session_destroy(i_session);
+	    if (pget_option.threads) {
+		/* back to worker_thread(). */
+		close(i_foo_fd);
+		hists_destroy();
+		return OK;
+	    }
+	    exit(0);
+	}
+	for (n = 1; n < nstarted; n++) {
+	    if (pget_option.threads)
+		pthread_join(threads[n], NULL);
+	    else
+		waitpid(childpid[n], NULL, 0);
+	}
+	i_path = i_root_path;
+    }
+
+    ramp_summary();
+
     ne_delete(i_session, i_path);
     ne_session_destroy(i_session);
     printf("\n\n");
@@ -410,6 +1235,50 @@ latency(struct timeval tv1, struct timeval  tv2)
     return ((tv2.tv_sec-tv1.tv_sec)*1000000+(tv2.tv_usec-tv1.tv_usec));
 }
 
+/* Response time [ns] of the last request completed on 'sess', which
+ * returned 'ret': from sending the request to having read all of the
+ * response body.  An error status is still a response, and timed; but
+ * a request which got none, so that the timing is still that of the
+ * one before, or was not timed through to its body, spoils the whole
+ * sample, and is counted instead. */
+ne_hrtime
+req_elapsed(ne_session *sess, int ret)
+{
+    const ne_request_timing *t = ne_get_last_timing(sess);
+    int stale = t->send_start == g_last_send;
+
+    g_last_send = t->send_start;
+    if (ret == NE_CONNECT || ret == NE_TIMEOUT
+	|| (ret != NE_OK && stale) || t->body_done < t->send_start) {
+	if (!g_sample_failed)
+	    g_counts[CNT_FAILURES]++;
+	g_sample_failed = 1;
+	return 0;
+    }
+    if (t->connected)
+	hist_record(g_connect, t->connected - t->connect_start);
+    if (pget_option.phases)
+	phase_record(t);
+    if (pget_option.syscalls) {
+	const ne_sock_stats *st = ne_get_last_syscalls(sess);
+	g_counts[CNT_REQUESTS]++;
+	g_counts[CNT_READS] += st->reads;
+	g_counts[CNT_WRITES] += st->writes;
+	g_counts[CNT_WAITS] += st->waits;
+	g_counts[CNT_SEGMENTS] += st->segments;
+    }
+    return t->body_done - t->send_start;
+}
+
+/* Record the latency 'lat' of a sample of the measured loop, unless
+ * one of its requests failed. */
+void sample_record(ne_hrtime lat)
+{
+    if (!g_sample_failed)
+	hist_record(g_hist, lat);
+    g_sample_failed = 0;
+}
+
 
 int
 my_mkcol(char* uri, int depth)
@@ -446,6 +1315,13 @@ my_mkcol(char* uri, int depth)
  */
 void
 my_mkcol2(char* uri, int depth)
+{
+	my_mkcol2_width(uri, depth, pget_option.width);
+}
+
+/* as my_mkcol2, with 'width' files at the bottom level. */
+void
+my_mkcol2_width(char* uri, int depth, int width)
 {
 	char tmp[256] = "/tmp/Davtest-XXXXXX";
 	char myuri[128];
@@ -467,15 +1343,15 @@ my_mkcol2(char* uri, int depth)
 			printf("ne_mkcol failed\n");
 			return;
 		}
-		# Return error if myuri + "sub/" is > 128
+		/* Return error if myuri + "sub/" is > 128 */
 		if (strlen(myuri) >= sizeof(myuri) - 4) {
 			printf("\nERROR: max depth reached.\n");	
 			exit(1);
 		} else {
-			my_mkcol2( myuri, depth-1);
+			my_mkcol2_width( myuri, depth-1, width);
 		}
 	}else if ( depth == 1)
-		for ( i=0; i<pget_option.width; i++){
+		for ( i=0; i<width; i++){
 			memset(myuri, 0, sizeof(myuri));
 			strcpy( myuri, uri);
 			sprintf( myuri, "%sfile%d", myuri, i);
@@ -485,6 +1361,7 @@ my_mkcol2(char* uri, int depth)
 			}
 		}
 
+	close(fd);
 	unlink(tmp);
 
 	return;
@@ -529,21 +1406,73 @@ my_mkcol2_proppatch(char* uri, int depth, const ne_propname pops[])
 void my_printf(char *src)
 {
 	char tmp[64];
+    double op_bytes = g_op_bytes;
 
+    g_op_bytes = 0;
     if ( g_echo ){	
 
 	memset(tmp, 0, 64);
 	memset(tmp, '.', 30);
 	strncpy(tmp, src, strlen(src));
-	printf("\n%s Rsp = %.0f [us]\n", tmp, g_average);
+	if (ramp_nrows > 0) {
+	    ramp_report(src);
+	    return;
+	}
+	if (pget_option.rate > 0)
+	    printf("\n%s Rsp = %.0f [us]  Thr = %.1f of %.1f [ops/s]\n", 
+		   tmp, g_average, g_ops, pget_option.rate);
+	else if (pget_option.concurrency > 1 || pget_option.async > 0)
+	    printf("\n%s Rsp = %.0f [us]  Thr = %.1f [ops/s]\n", 
+		   tmp, g_average, g_ops);
+	else
+	    printf("\n%s Rsp = %.0f [us]\n", tmp, g_average);
+	if (g_counts[CNT_FAILURES] > 0)
+	    printf("%*s %.0f failed, and not counted\n", 30, "",
+		   g_counts[CNT_FAILURES]);
+	if (g_merged < pget_option.concurrency)
+	    printf("%*s only %d of %d workers measured\n", 30, "",
+		   g_merged, pget_option.concurrency);
+	printf("%*s min = %.0f  p50 = %.0f  p90 = %.0f  p99 = %.0f"
+	       "  p99.9 = %.0f  max = %.0f [us]\n", 30, "",
+	       g_hist->min / 1000.0,
+	       hist_percentile(g_hist, 50) / 1000.0,
+	       hist_percentile(g_hist, 90) / 1000.0,
+	       hist_percentile(g_hist, 99) / 1000.0,
+	       hist_percentile(g_hist, 99.9) / 1000.0,
+	       g_hist->max / 1000.0);
+	if (pget_option.phases)
+	    phase_report();
+	else if (g_connect->count > 0)
+	    printf("%*s Connect: n = %lu  mean = %.0f  p50 = %.0f  p99 = %.0f"
+		   "  max = %.0f [us]\n", 30, "", g_connect->count,
+		   hist_mean(g_connect) / 1000,
+		   hist_percentile(g_connect, 50) / 1000.0,
+		   hist_percentile(g_connect, 99) / 1000.0,
+		   g_connect->max / 1000.0);
+	if (pget_option.syscalls && g_counts[CNT_REQUESTS] > 0) {
+	    printf("%*s Syscalls/request: read = %.1f  write = %.1f"
+		   "  wait = %.1f", 30, "",
+		   g_counts[CNT_READS] / g_counts[CNT_REQUESTS],
+		   g_counts[CNT_WRITES] / g_counts[CNT_REQUESTS],
+		   g_counts[CNT_WAITS] / g_counts[CNT_REQUESTS]);
+	    /* none at all means the platform does not count them. */
+	    if (g_counts[CNT_SEGMENTS] > 0)
+		printf("  segments = %.1f", 
+		       g_counts[CNT_SEGMENTS] / g_counts[CNT_REQUESTS]);
+	    printf("\n");
+	}
+	if (op_bytes > 0)
+	    printf("%*s Tput = %.1f [MB/s]  CPU = %.1f [ms]"
+		   "  %.1f [MB/s per core]\n", 30, "", g_ops * op_bytes / 1e6,
+		   g_cpu * 1000, g_cpu > 0 ? g_hist->count * op_bytes / g_cpu / 1e6 : 0);
 
     }
 }
 
 
 
-char test_context[BUFSIZ];
-int have_context = 0;
+PER_WORKER char test_context[BUFSIZ];
+PER_WORKER int have_context = 0;
 
 static FILE *child_debug, *debug;
 
@@ -551,14 +1480,15 @@ char **test_argv;
 int test_argc;
 
 const char *test_suite;
-int test_num;
+PER_WORKER int test_num;
 
 /* statistics for all tests so far */
 static int passes = 0, fails = 0, skipped = 0, warnings = 0;
 
 /* per-test globals: */
-static int warned, aborted = 0;
-static const char *test_name; /* current test name */
+static PER_WORKER int warned;
+static int aborted = 0;
+static PER_WORKER const char *test_name; /* current test name */
 
 static int use_colour = 0;
 
@@ -606,6 +1536,50 @@ void Usage( const char *prog) {
 	   "  -w, --Width		Width of collection at the bottom level(Default: 100) \n"
 	   "  -o, --Output		Output file\n"
 	   "  -m, --Methods		Type of Web Methods (WebDAV / WebFolder, Default: WebDAV)\n"
+	   "  -c, --Concurrency	Number of concurrent client processes (Default: 1)\n"
+	   "  -t, --Threads		Number of concurrent client threads, sharing one\n"
+	   "			process, instead of -c\n"
+	   "  -a, --Async		Requests in flight in the asynchronous GET test\n"
+	   "			(Default: 0, test not run)\n"
+	   "      --Uring		Drive the asynchronous GET test through io_uring\n"
+	   "			rather than epoll\n"
+	   "      --Pipeline	Depth of the pipelined GET, OPTIONS and PROPFIND\n"
+	   "			tests (Default: 0, tests not run)\n"
+	   "      --Listing		Widths of the collections listed by Depth:1 and\n"
+	   "			Depth:infinity PROPFINDs, e.g. 1000,10000,100000\n"
+	   "			(Default: none, test not run)\n"
+	   "      --Bigpatch	Properties and bytes in each of a PROPPATCH\n"
+	   "			generated as it is sent, e.g. 1000,64K\n"
+	   "			(Default: none, test not run)\n"
+	   "      --Phases		Break each latency down into DNS, connect, TLS,\n"
+	   "			send, time to first byte and receive phases\n"
+	   "      --Sink		Move GET bodies straight from the socket, to the\n"
+	   "			temporary `file' or to `null', without copying them\n"
+	   "      --Discard		Drain PROPFIND bodies, checking only that they nest\n"
+	   "			and their status codes, rather than parse them: `on',\n"
+	   "			or `both' to measure them both ways\n"
+	   "      --Rdbuf		Most each connection's read buffer may grow to,\n"
+	   "			e.g. 64K or 1M (Default: 4K)\n"
+	   "      --Syscalls	Report the system calls made, and TCP segments\n"
+	   "			sent, per request\n"
+	   "      --Dnsttl		Seconds the sessions reuse a resolved hostname\n"
+	   "			for; 0 resolves it for each (Default: 300)\n"
+	   "      --Family		Connect over IPv`4' or IPv`6' only\n"
+	   "      --Nagle		Leave Nagle's algorithm on (TCP_NODELAY off)\n"
+	   "      --Cork		Cork the connection (TCP_CORK) while sending\n"
+	   "			each request\n"
+	   "      --Timeout		Read timeout [ms] (Default: 120000)\n"
+	   "      --Ctimeout	Connect timeout [ms] (Default: none)\n"
+	   "      --Race		Connect to all the server's addresses at once,\n"
+	   "			and use the first to answer\n"
+	   "  -R, --Rate		Start requests at this rate, e.g. 2000/s, rather than\n"
+	   "			each as the last completes; latencies count from\n"
+	   "			when each request was due\n"
+	   "      --Poisson		Poisson rather than fixed request arrivals with -R\n"
+	   "      --Ramp		Raise the load in steps, and report where the server\n"
+	   "			saturates: `users' doubles the workers up to -c/-t,\n"
+	   "			+X/s adds X to the target rate, up to -R if given\n"
+	   "      --Step		Length of each ramp step [s] (Default: 5)\n"
 	   );
     printf("\nExample: %s http://dav.cse.ucsc.edu:81/basic test1 test1 -r 20 -p 20 -m WebFolder \n\n", prog);
 }
@@ -613,6 +1587,7 @@ void Usage( const char *prog) {
 
 int read_options(int argc, char *argv[]) {
     int optc;
+    char *end;
     
     static const struct option opts[] = {
 	{ "help", no_argument, NULL, 'h' },
@@ -623,6 +1598,29 @@ int read_options(int argc, char *argv[]) {
 	{ "depth", required_argument, NULL, 'd' },
 	{ "width", required_argument, NULL, 'w' },
 	{ "requests", required_argument, NULL, 'r' },
+	{ "concurrency", required_argument, NULL, 'c' },
+	{ "threads", required_argument, NULL, 't' },
+	{ "async", required_argument, NULL, 'a' },
+	{ "uring", no_argument, NULL, 'I' },
+	{ "pipeline", required_argument, NULL, 'L' },
+	{ "phases", no_argument, NULL, 'B' },
+	{ "listing", required_argument, NULL, 'W' },
+	{ "bigpatch", required_argument, NULL, 'N' },
+	{ "sink", required_argument, NULL, 'K' },
+	{ "discard", required_argument, NULL, 'X' },
+	{ "rdbuf", required_argument, NULL, 'Z' },
+	{ "syscalls", no_argument, NULL, 'Y' },
+	{ "timeout", required_argument, NULL, 'O' },
+	{ "ctimeout", required_argument, NULL, 'E' },
+	{ "race", no_argument, NULL, 'A' },
+	{ "dnsttl", required_argument, NULL, 'D' },
+	{ "family", required_argument, NULL, 'F' },
+	{ "nagle", no_argument, NULL, 'G' },
+	{ "cork", no_argument, NULL, 'C' },
+	{ "rate", required_argument, NULL, 'R' },
+	{ "poisson", no_argument, NULL, 'P' },
+	{ "ramp", required_argument, NULL, 'U' },
+	{ "step", required_argument, NULL, 'S' },
 	{ "quite", no_argument, NULL, 'q' },
 	{ 0, 0, 0, 0 }
     };
@@ -640,9 +1638,13 @@ int read_options(int argc, char *argv[]) {
     pget_option.width = DEFAULT_WIDTH;
     pget_option.requests = DEFAULT_REQUESTS;
     pget_option.numprops = DEFAULT_NUMPROPS;
+    pget_option.concurrency = DEFAULT_CONCURRENCY;
+    pget_option.async = 0;
+    pget_option.step_time = DEFAULT_STEP_TIME;
+    pget_option.dns_ttl = DEFAULT_DNS_TTL;
 
 
-    while ((optc = getopt_long(argc, argv, "p:o:d:w:r:m:hq", opts, NULL)) != -1) {
+    while ((optc = getopt_long(argc, argv, "p:o:d:w:r:m:c:t:a:R:hq", opts, NULL)) != -1) {
 	switch (optc) {
 	case '?': 
 	case 'h': Usage(argv[0]); exit(-1);
@@ -652,16 +1654,183 @@ int read_options(int argc, char *argv[]) {
 	case 'd': pget_option.depth = atoi(optarg); break;
 	case 'w': pget_option.width = atoi(optarg); break;
 	case 'o': pget_option.outfile = optarg; break;
+	case 'a': pget_option.async = atoi(optarg); break;
+	case 'I': pget_option.uring = 1; break;
+	case 'L': pget_option.pipeline = atoi(optarg); break;
+	case 'B': pget_option.phases = 1; break;
+	case 'Z': pget_option.rdbuf = strtoul(optarg, &end, 10);
+	    /* allow a unit of K or M */
+	    if (*end == 'K' || *end == 'k')
+		pget_option.rdbuf <<= 10, end++;
+	    else if (*end == 'M' || *end == 'm')
+		pget_option.rdbuf <<= 20, end++;
+	    if (pget_option.rdbuf == 0 || *end) {
+		Usage(argv[0]); exit(-1);
+	    }
+	    break;
+	case 'Y': pget_option.syscalls = 1; break;
+	case 'D': pget_option.dns_ttl = strtol(optarg, &end, 10);
+	    if (pget_option.dns_ttl < 0 || *end) {
+		Usage(argv[0]); exit(-1);
+	    }
+	    break;
+	case 'F':
+	    if (strcmp(optarg, "4") == 0)
+		pget_option.family = NE_ADDR_IPV4;
+	    else if (strcmp(optarg, "6") == 0)
+		pget_option.family = NE_ADDR_IPV6;
+	    else {
+		Usage(argv[0]); exit(-1);
+	    }
+	    break;
+	case 'G': pget_option.nagle = 1; break;
+	case 'C': pget_option.cork = 1; break;
+	case 'O': pget_option.timeout = atoi(optarg);
+	    if (pget_option.timeout < 1) {
+		Usage(argv[0]); exit(-1);
+	    }
+	    break;
+	case 'E': pget_option.ctimeout = atoi(optarg);
+	    if (pget_option.ctimeout < 1) {
+		Usage(argv[0]); exit(-1);
+	    }
+	    break;
+	case 'A': pget_option.race = 1; break;
+	case 'K': 
+	    if (strcmp(optarg, "file") == 0)
+		pget_option.sink = SINK_FILE;
+	    else if (strcmp(optarg, "null") == 0)
+		pget_option.sink = SINK_NULL;
+	    else {
+		Usage(argv[0]); exit(-1);
+	    }
+	    break;
+	case 'W':
+	    for (end = optarg; *end; end++) {
+		if (pget_option.nlistings == LIST_MAXWIDTHS) {
+		    Usage(argv[0]); exit(-1);
+		}
+		pget_option.listing[pget_option.nlistings] = strtol(end, &end, 10);
+		if (pget_option.listing[pget_option.nlistings++] < 1
+		    || (*end && *end != ',')) {
+		    Usage(argv[0]); exit(-1);
+		}
+		if (*end == '\0')
+		    break;
+	    }
+	    break;
+	case 'N': pget_option.bigpatch = strtol(optarg, &end, 10);
+	    if (pget_option.bigpatch < 1 || *end != ',') {
+		Usage(argv[0]); exit(-1);
+	    }
+	    pget_option.bigpatch_size = strtoul(end + 1, &end, 10);
+	    /* allow a unit of K or M */
+	    if (*end == 'K' || *end == 'k')
+		pget_option.bigpatch_size <<= 10, end++;
+	    else if (*end == 'M' || *end == 'm')
+		pget_option.bigpatch_size <<= 20, end++;
+	    if (*end) {
+		Usage(argv[0]); exit(-1);
+	    }
+	    break;
+	case 'X': 
+	    if (strcmp(optarg, "on") == 0)
+		pget_option.discard = DISCARD_ON;
+	    else if (strcmp(optarg, "both") == 0)
+		pget_option.discard = DISCARD_BOTH;
+	    else {
+		Usage(argv[0]); exit(-1);
+	    }
+	    break;
+	case 'R': pget_option.rate = strtod(optarg, &end);
+	    /* allow a unit of "/s" */
+	    if (pget_option.rate <= 0 || (*end && strcmp(end, "/s"))) {
+		Usage(argv[0]); exit(-1);
+	    }
+	    break;
+	case 'P': pget_option.poisson = 1; break;
+	case 'U': 
+	    if (strcmp(optarg, "users") == 0) {
+		pget_option.ramp = RAMP_USERS;
+		break;
+	    }
+	    pget_option.ramp = RAMP_RATE;
+	    pget_option.ramp_rate = strtod(optarg, &end);
+	    if (pget_option.ramp_rate <= 0 || (*end && strcmp(end, "/s"))) {
+		Usage(argv[0]); exit(-1);
+	    }
+	    break;
+	case 'S': pget_option.step_time = atoi(optarg);
+	    if (pget_option.step_time < 1) {
+		Usage(argv[0]); exit(-1);
+	    }
+	    break;
+	case 'c': 
+	case 't': pget_option.concurrency = atoi(optarg); 
+	    pget_option.threads = optc == 't';
+	    if (pget_option.concurrency < 1) {
+		Usage(argv[0]); exit(-1);
+	    }
+	    break;
 	default:
 	    printf("Try `%s --help' for more information.\n", argv[1]);
 	    return -1;
 	}
     }
 
+    if (pget_option.ramp == RAMP_USERS && pget_option.concurrency < 2) {
+	printf("--ramp users needs more than one worker (-c or -t).\n");
+	return -1;
+    }
+
     return 0;
 }
 
 
+/* Run the tests from g_tests[first] on, up to the end of the list;
+ * returns the index of the terminating entry. */
+static int run_tests(int first)
+{
+    int n;
+
+    for (n = first; !aborted && g_tests[n].fn != NULL; n++) {
+	int result;
+
+
+	test_name = g_tests[n].name;
+	have_context = 0;
+	test_num = n;
+	warned = 0;
+	fflush(stdout);
+
+	/* run the test. */
+	result = g_tests[n].fn();
+
+	/* skips come before any measurement, alike for every worker;
+	 * a failure may have left the others at a barrier. */
+	if (result == FAIL || result == FAILHARD)
+	    worker_drop(test_name);
+
+
+        if (g_tests[n].flags & T_EXPECT_FAIL) {
+            if (result == OK) {
+                t_context("test passed but expected failure");
+                result = FAIL;
+            } else if (result == FAIL)
+                result = OK;
+        }
+
+	/* align the result column if we've had warnings. */
+	if (warned) {
+	    printf("    %s ", dots);
+	}
+
+    }
+
+    return n;
+}
+
+
 int main(int argc, char *argv[])
 {
     int n, fd, i;
@@ -713,34 +1882,8 @@ int main(int argc, char *argv[])
    if ( !strcmp(pget_option.methods, "WebFolder") )
     	testp = &tests2[0];
 
-    for ( n=0; !aborted && testp[n].fn != NULL; n++) {
-	int result;
-
-
-	test_name = testp[n].name;
-	have_context = 0;
-	test_num = n;
-	warned = 0;
-	fflush(stdout);
-
-	/* run the test. */
-	result = testp[n].fn();
-
-
-        if (testp[n].flags & T_EXPECT_FAIL) {
-            if (result == OK) {
-                t_context("test passed but expected failure");
-                result = FAIL;
-            } else if (result == FAIL)
-                result = OK;
-        }
-
-	/* align the result column if we've had warnings. */
-	if (warned) {
-	    printf("    %s ", dots);
-	}
-
-    }
+    g_tests = testp;
+    n = run_tests(0);
 
     /* discount skipped tests */
     if (skipped) {
@@ -765,12 +1908,17 @@ ne_test tests[] =
 
    T(propinit), 
    T(proppatch), 
+   T(proppatchstream),
    T(propfinddead),
    T(propfindlive),
+   T(propfindlist),
 
    T(put_get1K),
    T(put_get64K),
    T(put_get1024K),
+   T(async_get1K),
+   T(async_get1M),
+   T(pipelined),
    T(my_single),
    T(my_collection),
 
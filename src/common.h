@@ -11,6 +11,8 @@
 #include <unistd.h>
 #include <math.h>
 
+#include "histogram.h"
+
 
 /* always use O_BINARY for cygwin/windows compatibility. */
 #ifndef O_BINARY
@@ -37,32 +39,88 @@ TF(options); TF(options_ping); TF(finish);
 /* And finish everything off */
 #define FINISH_TESTS T(finish), T(NULL)
 
+/* State private to each worker.  The workers of the threaded mode
+ * (-t N) share one address space, so whatever a worker changes as it
+ * runs the tests must be thread-local. */
+#define PER_WORKER __thread
+
 /* The sesssion to use. */
-extern ne_session *i_session, *i_session2;
+extern PER_WORKER ne_session *i_session, *i_session2;
 
 /* server details. */
 extern const char *i_hostname;
 extern int i_port;
 extern ne_sock_addr *i_address;
-extern char *i_path;
+extern PER_WORKER char *i_path;
+
+extern PER_WORKER float g_average, g_std_variance, g_ops;
+
+/* CPU time used by the client over the measured loop just run, summed
+ * over the workers [s]. */
+extern PER_WORKER float g_cpu;
+
+/* Body bytes moved by each operation of the measured loop just run;
+ * if set before my_printf(), the throughput in bytes is reported too,
+ * along with that per core of client CPU.  my_printf() clears it. */
+extern PER_WORKER double g_op_bytes;
+extern PER_WORKER int g_echo;
+
+/* latencies recorded by the measured loop in progress. */
+extern PER_WORKER histogram_t *g_hist;
+
+/* number of phases the --phases breakdown splits each request into:
+ * DNS lookup, connect, TLS handshake, send, time to first byte, and
+ * receiving the rest of the response. */
+#define NPHASES 6
 
-float g_average, g_std_variance, g_thrput, g_sum_thrput, g_ops;
-int g_pid;
+/* number of per-request counts summed over each measured loop: for
+ * --syscalls, requests, the reads, writes and waits they made, and
+ * the TCP segments they were sent in; and the requests which failed. */
+#define NCOUNTS 6
 
+/* Shared segment used by the concurrency modes (-c N, -t N): the
+ * workers meet at a barrier before and after every measured loop, and
+ * drop their histograms into hists so worker 0 can report on all of
+ * them. */
 typedef struct{
-    int synccnt;
+    volatile int synccnt;	/* workers arrived at the current barrier */
+    volatile int generation;	/* bumped each time the barrier opens */
     char cur_method[64];
-    float *rstlist;
-    float *rstlist2;
-    short *pause;
+    volatile double ramp_load;	/* load of the next ramp step, 0 at the end */
+    histogram_t *hists;		/* one per worker */
+    histogram_t *phase_hists;	/* NPHASES per worker, with --phases */
+    histogram_t *connect_hists;	/* one per worker */
+    double *counts;		/* NCOUNTS per worker */
+    float *rstlist2;		/* elapsed time of each worker's loop [us] */
+    float *cpulist;		/* CPU time used by each worker's loop [s] */
+    short *pause;		/* non-zero once a worker has given up */
 }process_share_t;
 process_share_t *g_sharep;
 
+/* index of this worker, and number of workers running (1 unless -c
+ * or -t) */
+extern PER_WORKER int g_worker, g_nworkers;
+
+ne_session *open_session(void);
+int spawn_workers(void);
+void time_begin(void);
+ne_hrtime rate_wait(void);
+void time_process(void);
+
+/* The ramp mode (--ramp) runs each measured loop several times over,
+ * as a series of steps at increasing load, rather than once:
+ *   for (ramp_begin(); ramp_step(); ) { ... } 
+ * and each step then lasts a fixed time rather than a fixed number of
+ * requests: loop_more(i) says whether to send request number i. */
+void ramp_begin(void);
+int ramp_step(void);
+int loop_more(int i);
+
 
 extern int i_class2; /* true if server is a class 2 DAV server. */
 
 /* If open_foo() has been called, this is the fd to the 'foo' file. */
-extern int i_foo_fd;
+extern PER_WORKER int i_foo_fd;
 
 /* Upload htdocs/foo to i_path + path */
 int upload_foo(const char *path);
@@ -93,6 +151,27 @@ int upload_foo(const char *path);
 #define MIN_PAUSETIME (7)
 #define WARMUP_TIME 2
 
+/* what the ramp mode raises from one step to the next */
+#define RAMP_USERS	1	/* workers: 1, 2, 4, ... */
+#define RAMP_RATE	2	/* target rate: X, 2X, 3X, ... [ops/s] */
+
+#define DEFAULT_STEP_TIME	5	/* [s] */
+
+/* how long a resolved hostname is reused by the sessions opened */
+#define DEFAULT_DNS_TTL	300	/* [s] */
+
+/* where the GET tests put response bodies with --sink, using
+ * ne_get_sink rather than ne_get. */
+#define SINK_FILE	1	/* a temporary file, as ne_get does */
+#define SINK_NULL	2	/* nowhere: they are only counted */
+
+/* how the PROPFIND tests treat 207 bodies with --discard */
+#define DISCARD_ON	1	/* drained and counted, not parsed */
+#define DISCARD_BOTH	2	/* measured parsed, then drained */
+
+/* most collection widths the listing tests may be given */
+#define LIST_MAXWIDTHS	8
+
 #define DEFAULT_DEPTH	10
 #define DEFAULT_WIDTH	100
 #define DEFAULT_REQUESTS	100
@@ -100,135 +179,153 @@ int upload_foo(const char *path);
 #define DEFAULT_NUMPROPS	10
 
 
-#define time_process(num) \
-{\
-	int i, num2;\
-	g_average =0; \
-	qsort(times1, num, sizeof(float), time_comp);\
-	num2 = time_filter(times1, times2, num, times1[num/2], 0.05);\
-	for(i=0; i<num2; i++)\
-		g_average += times2[i];\
-	g_average /= num2;\
-	for ( i=0; i<num2; i++)\
-	    g_std_variance += (g_average-times2[i])*(g_average-times2[i]);\
-	g_std_variance = sqrt(g_std_variance/num2);\
-}
-
-
 #define SEND_REQUEST(METHOD) \
 { \
 	int i;\
-	for( i=0; i<pget_option.requests; i++){ \
-	    	METHOD; \
-		times1[i] = latency(g_tv1, g_tv2);  \
+	ne_hrtime lat, lag;\
+	for (ramp_begin(); ramp_step(); ) { \
+	time_begin();\
+	for( i=0; loop_more(i); i++){ \
+		lag = rate_wait(); \
+		lat = req_elapsed(i_session, METHOD); \
+		sample_record(lat + lag); \
+	} \
+	time_process();\
 	} \
-	time_process(pget_option.requests);\
 }
 
 #define SEND_REQUEST_TWO(METHOD, METHOD2) \
 { \
 	int i;\
-	for( i=0; i<pget_option.requests; i++){ \
-	    	METHOD; \
-		times1[i] = latency(g_tv1, g_tv2);  \
-	    	METHOD2; \
-		times1[i] += latency(g_tv1, g_tv2);  \
+	ne_hrtime lat, lag;\
+	for (ramp_begin(); ramp_step(); ) { \
+	time_begin();\
+	for( i=0; loop_more(i); i++){ \
+		lag = rate_wait(); \
+		lat = req_elapsed(i_session, METHOD); \
+		lat += req_elapsed(i_session, METHOD2); \
+		sample_record(lat + lag); \
+	} \
+	time_process();\
 	} \
-	time_process(pget_option.requests);\
 }
 
 #define SEND_REQUEST_FOUR(METHOD, METHOD2, METHOD3, METHOD4) \
 { \
 	int i;\
-	for( i=0; i<pget_option.requests; i++){ \
-	    	METHOD; \
-		times1[i] = latency(g_tv1, g_tv2);  \
-	    	METHOD2; \
-		times1[i] += latency(g_tv1, g_tv2);  \
-	    	METHOD3; \
-		times1[i] += latency(g_tv1, g_tv2);  \
-	    	METHOD4; \
-		times1[i] += latency(g_tv1, g_tv2);  \
+	ne_hrtime lat, lag;\
+	for (ramp_begin(); ramp_step(); ) { \
+	time_begin();\
+	for( i=0; loop_more(i); i++){ \
+		lag = rate_wait(); \
+		lat = req_elapsed(i_session, METHOD); \
+		lat += req_elapsed(i_session, METHOD2); \
+		lat += req_elapsed(i_session, METHOD3); \
+		lat += req_elapsed(i_session, METHOD4); \
+		sample_record(lat + lag); \
+	} \
+	time_process();\
 	} \
-	time_process(pget_option.requests);\
 }
 
 #define SEND_REQUEST2(METHOD1, METHOD2) \
 { \
 	int i;\
-	for( i=0; i<pget_option.requests; i++){ \
+	ne_hrtime lat, lag;\
+	for (ramp_begin(); ramp_step(); ) { \
+	time_begin();\
+	for( i=0; loop_more(i); i++){ \
+		lag = rate_wait(); \
 		METHOD1; \
-	    	METHOD2; \
-		times1[i] = latency(g_tv1, g_tv2); \
+		lat = req_elapsed(i_session, METHOD2); \
+		sample_record(lat + lag); \
+	} \
+	time_process();\
 	} \
-	time_process(pget_option.requests);\
 }
 
 #define SEND_REQUEST2_THREE(METHOD1, METHOD2_1, METHOD2_2) \
 { \
 	int i;\
-	for( i=0; i<pget_option.requests; i++){ \
+	ne_hrtime lat, lag;\
+	for (ramp_begin(); ramp_step(); ) { \
+	time_begin();\
+	for( i=0; loop_more(i); i++){ \
+		lag = rate_wait(); \
 		METHOD1; \
-	    	METHOD2_1; \
-		times1[i] = latency(g_tv1, g_tv2); \
-	    	METHOD2_2; \
-		times1[i] += latency(g_tv1, g_tv2); \
+		lat = req_elapsed(i_session, METHOD2_1); \
+		lat += req_elapsed(i_session, METHOD2_2); \
+		sample_record(lat + lag); \
+	} \
+	time_process();\
 	} \
-	time_process(pget_option.requests);\
 }
 
 #define SEND_REQUEST2_FOUR(METHOD1, METHOD2_1, METHOD2_2, METHOD2_3) \
 { \
 	int i;\
-	for( i=0; i<pget_option.requests; i++){ \
+	ne_hrtime lat, lag;\
+	for (ramp_begin(); ramp_step(); ) { \
+	time_begin();\
+	for( i=0; loop_more(i); i++){ \
+		lag = rate_wait(); \
 		METHOD1; \
-	    	METHOD2_1; \
-		times1[i] = latency(g_tv1, g_tv2); \
-	    	METHOD2_2; \
-		times1[i] += latency(g_tv1, g_tv2); \
-	    	METHOD2_3; \
-		times1[i] += latency(g_tv1, g_tv2); \
+		lat = req_elapsed(i_session, METHOD2_1); \
+		lat += req_elapsed(i_session, METHOD2_2); \
+		lat += req_elapsed(i_session, METHOD2_3); \
+		sample_record(lat + lag); \
+	} \
+	time_process();\
 	} \
-	time_process(pget_option.requests);\
 }
 
 #define SEND_REQUEST3(METHOD1, METHOD2) \
 { \
 	int i;\
-	for( i=0; i<pget_option.requests; i++){ \
-	    	METHOD1; \
-		times1[i] = latency(g_tv1, g_tv2); \
+	ne_hrtime lat, lag;\
+	for (ramp_begin(); ramp_step(); ) { \
+	time_begin();\
+	for( i=0; loop_more(i); i++){ \
+		lag = rate_wait(); \
+		lat = req_elapsed(i_session, METHOD1); \
 		METHOD2; \
+		sample_record(lat + lag); \
+	} \
+	time_process();\
 	} \
-	time_process(pget_option.requests);\
 }
 
 #define SEND_REQUEST3_FOUR(METHOD1_1, METHOD1_2, METHOD1_3, METHOD2) \
 { \
 	int i;\
-	for( i=0; i<pget_option.requests; i++){ \
-	    	METHOD1_1; \
-		times1[i] = latency(g_tv1, g_tv2); \
-	    	METHOD1_2; \
-		times1[i] += latency(g_tv1, g_tv2); \
-	    	METHOD1_3; \
-		times1[i] += latency(g_tv1, g_tv2); \
+	ne_hrtime lat, lag;\
+	for (ramp_begin(); ramp_step(); ) { \
+	time_begin();\
+	for( i=0; loop_more(i); i++){ \
+		lag = rate_wait(); \
+		lat = req_elapsed(i_session, METHOD1_1); \
+		lat += req_elapsed(i_session, METHOD1_2); \
+		lat += req_elapsed(i_session, METHOD1_3); \
 		METHOD2; \
+		sample_record(lat + lag); \
+	} \
+	time_process();\
 	} \
-	time_process(pget_option.requests);\
 }
 
-int time_comp(const void* tv1, const void* tv2);
-int time_filter(float a[], float b[], int nelm, float median, float percentage);
-float *times1, *times2;
-
 inline int latency(struct timeval sec, struct timeval usec);
+ne_hrtime req_elapsed(ne_session *sess, int ret);
+void sample_record(ne_hrtime lat);
 int my_mkcol(char* uri, int depth);
 void my_mkcol2(char* uri, int depth);
+void my_mkcol2_width(char* uri, int depth, int width);
 
 int put_get1K(void);
 int put_get64K(void);
 int put_get1024K(void);
+int async_get1K(void);
+int async_get1M(void);
+int pipelined(void);
 int mkcol(void);
 int my_copymovedelete(void);
 
@@ -272,6 +369,36 @@ struct options_t {
     int width;
     int requests;
     int concurrency;
+    int threads;	/* the workers are threads rather than processes */
+    int async;		/* requests in flight for async_get1K */
+    int uring;		/* drive async_get1K through io_uring */
+    int pipeline;	/* pipeline depth for pipelined, or 0 */
+    int phases;		/* break each latency down by phase */
+    int listing[LIST_MAXWIDTHS];	/* collection widths for propfindlist */
+    int nlistings;	/* number of them, or 0 for the test not to run */
+    int bigpatch;	/* properties in the streamed PROPPATCH, or 0 for
+			 * proppatchstream not to run */
+    size_t bigpatch_size;	/* bytes in the value of each */
+    int sink;		/* SINK_FILE or SINK_NULL for the GET tests, or 0
+			 * to read bodies through ne_get */
+    int discard;	/* DISCARD_ON or DISCARD_BOTH, or 0 to parse
+			 * PROPFIND bodies only */
+    size_t rdbuf;	/* most a connection's read buffer may grow to,
+			 * or 0 for neon's default */
+    int syscalls;	/* report the system calls made per request */
+    int timeout;	/* read timeout [ms], or 0 for neon's default */
+    int ctimeout;	/* connect timeout [ms], or 0 for none */
+    int race;		/* connect to all the server's addresses at once */
+    int nagle;		/* leave TCP_NODELAY off */
+    int dns_ttl;	/* TTL of the address cache [s], 0 to disable it */
+    int family;		/* NE_ADDR_IPV4 or NE_ADDR_IPV6, or 0 for any */
+    int cork;		/* cork connections while sending each request */
+    double rate;	/* target rate [ops/s] across all workers, or 0
+			 * to send each request as the last completes */
+    int poisson;	/* Poisson rather than fixed inter-arrival times */
+    int ramp;		/* RAMP_USERS or RAMP_RATE, or 0 for no ramp */
+    double ramp_rate;	/* rate added at each step with RAMP_RATE */
+    int step_time;	/* minimum length of a ramp step [s] */
     int numprops;
     int nummethods;
 }pget_option; 
@@ -293,7 +420,7 @@ extern ne_test tests2[];
 #define T_LEAKY(fn) { fn, #fn, 0 }
 
 /* current test number */
-extern int test_num;
+extern PER_WORKER int test_num;
 
 /* name of test suite */
 extern const char *test_suite;
@@ -305,7 +432,7 @@ void t_context(const char *ctx, ...)
 #endif /* __GNUC__ */
     ;
 
-extern char test_context[];
+extern PER_WORKER char test_context[];
 
 /* the command-line arguments passed in to the test suite: */
 extern char **test_argv;
@@ -366,6 +493,8 @@ int   my_single();
 int   wf_my_single();
 int   my_collection();
 int   locks();
+int   propfindlist();
+int   proppatchstream();
 
 
 /*************************************/
@@ -0,0 +1,134 @@
+#include <sys/types.h>
+#include <stdlib.h>
+#include <math.h>
+#include <config.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "ne_alloc.h"
+#include "histogram.h"
+
+/* Index of the highest bit set in v; v must be non-zero. */
+static int msb(ne_hrtime v)
+{
+    int n = 0;
+
+    while (v >>= 1)
+	n++;
+    return n;
+}
+
+static unsigned int bucket_index(ne_hrtime v)
+{
+    int shift;
+
+    if (v < HIST_SUB)
+	return v;
+    if (v >> HIST_MAX_BITS)
+	return HIST_NBUCKETS - 1;
+    shift = msb(v) - (HIST_SUB_BITS - 1);
+    return shift * HIST_HALF + (v >> shift);
+}
+
+/* Highest value which lands in bucket 'idx'. */
+static ne_hrtime bucket_top(unsigned int idx)
+{
+    int shift;
+
+    if (idx < HIST_SUB)
+	return idx;
+    shift = idx / HIST_HALF - 1;
+    return (((ne_hrtime)(idx - shift * HIST_HALF) + 1) << shift) - 1;
+}
+
+histogram_t *hist_create(void)
+{
+    histogram_t *h = ne_malloc(sizeof *h);
+
+    hist_reset(h);
+    return h;
+}
+
+void hist_destroy(histogram_t *h)
+{
+    ne_free(h);
+}
+
+void hist_reset(histogram_t *h)
+{
+    memset(h, 0, sizeof *h);
+}
+
+void hist_record(histogram_t *h, ne_hrtime value)
+{
+    if (h->count == 0 || value < h->min)
+	h->min = value;
+    if (value > h->max)
+	h->max = value;
+    h->count++;
+    h->sum += value;
+    h->sumsq += (double)value * value;
+    h->buckets[bucket_index(value)]++;
+}
+
+void hist_merge(histogram_t *to, const histogram_t *from)
+{
+    int n;
+
+    if (from->count == 0)
+	return;
+    if (to->count == 0 || from->min < to->min)
+	to->min = from->min;
+    if (from->max > to->max)
+	to->max = from->max;
+    to->count += from->count;
+    to->sum += from->sum;
+    to->sumsq += from->sumsq;
+    for (n = 0; n < HIST_NBUCKETS; n++)
+	to->buckets[n] += from->buckets[n];
+}
+
+ne_hrtime hist_percentile(const histogram_t *h, double percentile)
+{
+    unsigned long want, seen = 0;
+    ne_hrtime v;
+    int n;
+
+    if (h->count == 0)
+	return 0;
+
+    want = (unsigned long)ceil(percentile / 100 * h->count);
+    if (want < 1)
+	want = 1;
+
+    for (n = 0; n < HIST_NBUCKETS; n++) {
+	seen += h->buckets[n];
+	if (seen >= want)
+	    break;
+    }
+
+    /* the exact extremes are known; don't report past them. */
+    v = bucket_top(n);
+    if (v > h->max)
+	v = h->max;
+    if (v < h->min)
+	v = h->min;
+    return v;
+}
+
+double hist_mean(const histogram_t *h)
+{
+    return h->count ? h->sum / h->count : 0;
+}
+
+double hist_stddev(const histogram_t *h)
+{
+    double mean = hist_mean(h), var;
+
+    if (h->count == 0)
+	return 0;
+    var = h->sumsq / h->count - mean * mean;
+    return var > 0 ? sqrt(var) : 0;
+}
@@ -0,0 +1,46 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H 1
+
+#include <ne_utils.h> /* for ne_hrtime */
+
+/* Latency histogram with log-linear buckets, in the style of
+ * HdrHistogram: values below HIST_SUB are counted exactly, above
+ * that each power of two is split into HIST_SUB/2 equal buckets, so
+ * any recorded value is known to within 1/128 of itself.  The memory
+ * used is fixed however many values are recorded, and a histogram
+ * holds no pointers, so it can be copied into shared memory and
+ * merged with those of the other workers. */
+
+#define HIST_SUB_BITS	8
+#define HIST_SUB	(1 << HIST_SUB_BITS)
+#define HIST_HALF	(HIST_SUB / 2)
+/* values from 2^HIST_MAX_BITS [ns] up (about 18 min) go in the top
+ * bucket. */
+#define HIST_MAX_BITS	40
+#define HIST_NBUCKETS	((HIST_MAX_BITS - HIST_SUB_BITS + 2) * HIST_HALF)
+
+typedef struct{
+    unsigned long count;
+    ne_hrtime min, max;
+    double sum, sumsq;		/* for the mean and standard deviation */
+    unsigned int buckets[HIST_NBUCKETS];
+}histogram_t;
+
+histogram_t *hist_create(void);
+void hist_destroy(histogram_t *h);
+void hist_reset(histogram_t *h);
+
+/* Record one value [ns]. */
+void hist_record(histogram_t *h, ne_hrtime value);
+
+/* Add all the values recorded in 'from' to 'to'. */
+void hist_merge(histogram_t *to, const histogram_t *from);
+
+/* Returns the value below which 'percentile' percent of the recorded
+ * values fall, or 0 if the histogram is empty. */
+ne_hrtime hist_percentile(const histogram_t *h, double percentile);
+
+double hist_mean(const histogram_t *h);
+double hist_stddev(const histogram_t *h);
+
+#endif /* HISTOGRAM_H */
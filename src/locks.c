@@ -11,11 +11,10 @@
 
 #include "common.h"
 
-static char *res, *res2;
-static ne_lock_store *store;
-extern struct timeval g_tv1, g_tv2;
+static PER_WORKER char *res, *res2;
+static PER_WORKER ne_lock_store *store;
 
-static struct ne_lock reslock, *gotlock = NULL;
+static PER_WORKER struct ne_lock reslock, *gotlock = NULL;
 
 static int precond(void)
 {
@@ -31,8 +30,6 @@ static int precond(void)
 /* Get a lock, store pointer in global 'getlock'. */
 int locks(void)
 {
-    struct timeval tv1, tv2;
-
     res = ne_concat(i_path, "lockme", NULL);
     CALL(upload_foo("lockme"));
 
@@ -6,6 +6,7 @@
 
 #include <ne_request.h>
 #include <ne_props.h>
+#include <ne_207.h>
 #include <ne_uri.h>
 
 #include "common.h"
@@ -42,11 +43,13 @@ struct private {
 struct results {
     ne_propfind_handler *ph;
     int result;
+    int verify;		/* check the values of the dead properties */
+    int wrong;		/* values found missing or wrong */
 };
 
 
-static int prop_ok = 0;
-char *prop_uri, *prop_uri2, *prop_uri3;
+static PER_WORKER int prop_ok = 0;
+PER_WORKER char *prop_uri, *prop_uri2, *prop_uri3;
 
 int propinit(void)
 {
@@ -62,20 +65,36 @@ int propinit(void)
     return OK;
 }
 
-#define MAXNP 1024
+/* The properties patched and found, grown to fit -p; the live
+ * property tests use NLIVE of them. */
+#define NLIVE 11
 
-static ne_proppatch_operation pops[MAXNP + 1];
-static ne_propname propnames[MAXNP + 1];
-static char *values[MAXNP + 1];
+static PER_WORKER ne_proppatch_operation *pops;
+static PER_WORKER ne_propname *propnames;
+static PER_WORKER char **values;
+static PER_WORKER int maxnp;
 
-extern int numprops, removedprops;
-extern struct timeval g_tv1, g_tv2;
+/* Make room for 'count' properties, and the entry which ends them. */
+static void prop_room(int count)
+{
+    if (count < NLIVE)
+	count = NLIVE;
+    if (count < maxnp)
+	return;
+    maxnp = count + 1;
+    pops = ne_realloc(pops, maxnp * sizeof *pops);
+    propnames = ne_realloc(propnames, maxnp * sizeof *propnames);
+    values = ne_realloc(values, maxnp * sizeof *values);
+}
+
+extern int removedprops;
 extern int *g_intp;
 
 #define PS_VALUE "value goes here"
 
 int proppatch(void)
 {
+    ne_request_template *tpl;
     int n;
     char tmp[100];
 
@@ -93,7 +112,8 @@ int proppatch(void)
     CALL(upload_foo(tmp));
 
     /* multiple property */
-    for (n = 0; n < numprops; n++) {
+    prop_room(pget_option.numprops);
+    for (n = 0; n < pget_option.numprops; n++) {
 	sprintf(tmp, "prop%d", n);
 	propnames[n].nspace = NS;
 	propnames[n].name = ne_strdup(tmp);
@@ -108,7 +128,10 @@ int proppatch(void)
     memset(&propnames[n], 0, sizeof(propnames[n]));	   
     values[n] = NULL;
 
-    SEND_REQUEST(ne_proppatch(i_session, prop_uri, pops));
+    /* the body is serialized once, outside the measured loop. */
+    tpl = ne_proppatch_template(i_session, pops);
+    SEND_REQUEST(ne_proppatch_tpl(tpl, prop_uri));
+    ne_template_destroy(tpl);
     my_printf("ProppatchMult");
 
     /* singel property */
@@ -117,12 +140,87 @@ int proppatch(void)
     memset(&propnames[n], 0, sizeof(propnames[n]));	   
     values[n] = NULL;
 
-    SEND_REQUEST(ne_proppatch(i_session, prop_uri2, pops));
+    tpl = ne_proppatch_template(i_session, pops);
+    SEND_REQUEST(ne_proppatch_tpl(tpl, prop_uri2));
+    ne_template_destroy(tpl);
     my_printf("ProppatchSingle");
 
     return OK;
 }
 
+/* The streamed PROPPATCH test: --bigpatch N,S sets N properties of S
+ * bytes each, in a body generated as it is sent, so that N x S may
+ * be far more than fits in memory.  The properties all share the one
+ * value. */
+struct bigpatch {
+    int next, count;
+    ne_propname name;
+    char tmp[32];
+    const char *value;
+};
+
+static int bigpatch_iter(void *userdata, ne_proppatch_operation *op)
+{
+    struct bigpatch *bp = userdata;
+
+    if (op == NULL) {
+	bp->next = 0;
+	return 0;
+    }
+    if (bp->next == bp->count)
+	return 0;
+
+    sprintf(bp->tmp, "big%d", bp->next++);
+    bp->name.nspace = NS;
+    bp->name.name = bp->tmp;
+    op->name = &bp->name;
+    op->type = ne_propset;
+    op->value = bp->value;
+    return 1;
+}
+
+int proppatchstream(void)
+{
+    struct bigpatch bp;
+    char *uri, *value;
+    int ret = OK;
+
+    if (pget_option.bigpatch < 1)
+	return OK;
+
+    value = ne_malloc(pget_option.bigpatch_size + 1);
+    memset(value, 'x', pget_option.bigpatch_size);
+    value[pget_option.bigpatch_size] = '\0';
+
+    memset(&bp, 0, sizeof bp);
+    bp.count = pget_option.bigpatch;
+    bp.value = value;
+
+    uri = ne_concat(i_path, "bigpatch", NULL);
+    ne_delete(i_session, uri);
+    if (upload_foo("bigpatch") != OK) {
+	ret = FAIL;
+	goto out;
+    }
+
+    /* once untimed, as servers may limit the size of a body. */
+    if (ne_proppatch_stream(i_session, uri, bigpatch_iter, &bp)) {
+	t_context("PROPPATCH of %s: %s", uri, ne_get_error(i_session));
+	ret = FAIL;
+	goto out;
+    }
+
+    SEND_REQUEST(ne_proppatch_stream(i_session, uri, bigpatch_iter, &bp));
+    g_op_bytes = (double)pget_option.bigpatch * pget_option.bigpatch_size;
+    my_printf("ProppatchStream");
+
+out:
+    ne_delete(i_session, uri);
+    ne_free(value);
+    ne_free(uri);
+    return ret;
+}
+
 static void
 my_pg_results(void *userdata, const char *uri,
 		const ne_prop_result_set *rset)
@@ -130,11 +228,91 @@ my_pg_results(void *userdata, const char *uri,
     struct results *r = userdata;
 
     r->result = FAIL;
+}
+
+/* Count the dead property values missing from 'rset', or not those
+ * patched; used for a PROPFIND outside the timed ones. */
+static void
+check_results(void *userdata, const char *uri,
+	      const ne_prop_result_set *rset)
+{
+    struct results *r = userdata;
+    int n;
+
+    for (n = 0; propnames[n].name != NULL; n++) {
+	const char *value = ne_propset_value(rset, &propnames[n]);
+	if (value == NULL || strcmp(value, values[n]) != 0)
+	    r->wrong++;
+    }
+}
+
+static void report_wrong(const struct results *r)
+{
+    if (g_echo && r->wrong > 0)
+	printf("%*s %d property values missing or wrong\n", 30, "",
+	       r->wrong);
+}
+
+/* Time the PROPFIND from 'tpl' on 'uri', reported as 'name'.  With
+ * --discard the 207 bodies are drained rather than parsed, and with
+ * --discard both it is timed both ways, so the difference is the
+ * client's cost of parsing them. */
+static void time_propfind(ne_request_template *tpl, const char *uri,
+			  struct results *r, char *name)
+{
+    ne_207_tally tally;
+    float rsp = 0, cpu = 0;
+    char tmp[64];
+    int n;
+
+    /* once untimed, so that checking the values costs nothing of what
+     * is measured. */
+    r->wrong = 0;
+    if (r->verify
+	&& ne_simple_propfind_tpl(tpl, uri, check_results, r) != NE_OK) {
+	printf("WARNING: PROPFIND to check %s failed: %s\n", uri,
+	       ne_get_error(i_session));
+	/* none could be checked. */
+	for (n = 0; propnames[n].name != NULL; n++)
+	    r->wrong++;
+    }
+
+    if (pget_option.discard != DISCARD_ON) {
+	SEND_REQUEST(ne_simple_propfind_tpl(tpl, uri, my_pg_results, r));
+	rsp = g_average;
+	cpu = g_hist->count > 0 ? g_cpu / g_hist->count : 0;
+	my_printf(name);
+	report_wrong(r);
+	if (!pget_option.discard)
+	    return;
+    }
 
+    memset(&tally, 0, sizeof tally);
+    ne_207_set_discard(i_session, &tally);
+    SEND_REQUEST(ne_simple_propfind_tpl(tpl, uri, my_pg_results, r));
+    ne_207_set_discard(i_session, NULL);
+    if (tally.bodies > 0)
+	g_op_bytes = (double)tally.bytes / tally.bodies;
+
+    if (pget_option.discard == DISCARD_ON) {
+	my_printf(name);
+	report_wrong(r);
+    } else {
+	ne_snprintf(tmp, sizeof tmp, "%s (drained)", name);
+	my_printf(tmp);
+    }
+    if (g_echo && tally.bodies > 0)
+	printf("%*s 207: %.1f responses/body  %d non-2xx status\n", 30, "",
+	       (double)tally.responses / tally.bodies, tally.failures);
+    if (pget_option.discard == DISCARD_BOTH && g_echo && !pget_option.ramp 
+	&& g_hist->count > 0)
+	printf("%*s Parse: Rsp = %+.0f [us]  CPU = %+.0f [us/op]\n", 30, "",
+	       rsp - g_average, (cpu - g_cpu / g_hist->count) * 1e6);
 }
 
 int propfinddead(void)
 {
+    ne_request_template *tpl;
     int n;
     char tmp[128]; 
     int ret;
@@ -145,9 +323,11 @@ int propfinddead(void)
     PRECOND(prop_ok);
 
     r.result = 1;
+    r.verify = 1;
     t_context("No responses returned");
 
-    for (n = 0; n < numprops; n++) {
+    prop_room(pget_option.numprops);
+    for (n = 0; n < pget_option.numprops; n++) {
 	sprintf(tmp, "prop%d", n);
 	propnames[n].nspace = NS;
 	propnames[n].name = ne_strdup(tmp);
@@ -179,9 +359,9 @@ int propfinddead(void)
 
 
      /* multiple dead properties */
-    SEND_REQUEST(ne_simple_propfind(i_session, prop_uri, 
-    		NE_DEPTH_ZERO,propnames, my_pg_results, &r));
-    my_printf("PropfindDeadMult");
+    tpl = ne_propfind_template(i_session, NE_DEPTH_ZERO, propnames);
+    time_propfind(tpl, prop_uri, &r, "PropfindDeadMult");
+    ne_template_destroy(tpl);
 
 
     /* single dead property */
@@ -190,9 +370,9 @@ int propfinddead(void)
     memset(&propnames[n], 0, sizeof(propnames[n]));	   
     values[n] = NULL;
 
-    SEND_REQUEST(ne_simple_propfind(i_session, prop_uri2, 
-    		NE_DEPTH_ZERO,propnames, my_pg_results, &r));
-    my_printf("PropfindDeadSingle");
+    tpl = ne_propfind_template(i_session, NE_DEPTH_ZERO, propnames);
+    time_propfind(tpl, prop_uri2, &r, "PropfindDeadSingle");
+    ne_template_destroy(tpl);
 
 
     return OK;
@@ -201,6 +381,7 @@ int propfinddead(void)
 
 int propfindlive(void)
 {
+    ne_request_template *tpl;
     int n;
     char tmp[128]; 
     int ret;
@@ -231,6 +412,7 @@ int propfindlive(void)
 
 
     /* multiple live properties */
+    prop_room(NLIVE);
 
     for (n = 0; n <10 ; n++) {
 	propnames[n].nspace = "DAV:";
@@ -273,9 +455,9 @@ int propfindlive(void)
 
     memset(&propnames[n], 0, sizeof(propnames[n]));	   
 
-    SEND_REQUEST(ne_simple_propfind(i_session, prop_uri2, 
-    			NE_DEPTH_ZERO,propnames, my_pg_results, &r));
-    my_printf("PropfindLiveMult");
+    tpl = ne_propfind_template(i_session, NE_DEPTH_ZERO, propnames);
+    time_propfind(tpl, prop_uri2, &r, "PropfindLiveMult");
+    ne_template_destroy(tpl);
 
 
     /* single live property */
@@ -288,11 +470,148 @@ int propfindlive(void)
     memset(&propnames[n], 0, sizeof(propnames[n]));	   
 
 
-    SEND_REQUEST(ne_simple_propfind(i_session, prop_uri2, 
-    			NE_DEPTH_ZERO,propnames, my_pg_results, &r));
-    my_printf("PropfindLiveSingle");
+    tpl = ne_propfind_template(i_session, NE_DEPTH_ZERO, propnames);
+    time_propfind(tpl, prop_uri2, &r, "PropfindLiveSingle");
+    ne_template_destroy(tpl);
+
+
+    return OK;
+}
+
+
+/* The listing tests: PROPFINDs of Depth:1 over a collection of
+ * --listing members, and of Depth:infinity over the tree above it,
+ * made by allprop, by name, and for the property names. */
+#define LIST_ALLPROP	0
+#define LIST_NAMED	1
+#define LIST_NAMES	2
+
+static const char *const list_names[] = {
+    "ListAllprop", "ListNamed", "ListNames"
+};
+
+struct listing {
+    int count;			/* PROPFINDs made */
+    int responses;		/* resources listed by them */
+    off_t bytes;		/* their body bytes */
+    off_t last;			/* body bytes of the last so far */
+};
+
+static void list_progress(void *userdata, off_t progress, off_t total)
+{
+    struct listing *l = userdata;
+    l->last = progress;
+}
+
+static void list_results(void *userdata, const char *href,
+			 const ne_prop_result_set *set)
+{
+    struct listing *l = userdata;
+    l->responses++;
+}
+
+static int list_once(const char *uri, int depth, int kind, 
+		     struct listing *l)
+{
+    ne_propfind_handler *ph;
+    int ret;
 
+    l->last = 0;
+    if (kind == LIST_NAMES) {
+	ret = ne_propnames(i_session, uri, depth, list_results, l);
+    } else {
+	ph = ne_propfind_create(i_session, uri, depth);
+	if (kind == LIST_ALLPROP)
+	    ret = ne_propfind_allprop(ph, list_results, l);
+	else
+	    ret = ne_propfind_named(ph, props, list_results, l);
+	ne_propfind_destroy(ph);
+    }
+    l->count++;
+    l->bytes += l->last;
+    return ret;
+}
 
+/* Time the listing of 'uri' at 'depth', reporting the responses and
+ * bytes per second with the latency.  With --discard on the bodies
+ * are drained, and the responses counted from the scan. */
+static int time_list(const char *uri, int depth, int kind, int width)
+{
+    struct listing l;
+    ne_207_tally tally;
+    double per;
+    char tmp[64];
+
+    ne_snprintf(tmp, sizeof tmp, "%s %s %d", list_names[kind],
+		depth == NE_DEPTH_ONE ? "D1" : "Dinf", width);
+
+    /* once untimed: servers may refuse Depth:infinity. */
+    memset(&l, 0, sizeof l);
+    if (list_once(uri, depth, kind, &l) != NE_OK) {
+	if (depth == NE_DEPTH_ONE) {
+	    t_context("%s: %s", tmp, ne_get_error(i_session));
+	    return FAIL;
+	}
+	if (g_echo)
+	    printf("\n%s not run: %s\n", tmp, ne_get_error(i_session));
+	return OK;
+    }
+
+    memset(&l, 0, sizeof l);
+    memset(&tally, 0, sizeof tally);
+    ne_set_progress(i_session, list_progress, &l);
+    if (pget_option.discard == DISCARD_ON)
+	ne_207_set_discard(i_session, &tally);
+    SEND_REQUEST(list_once(uri, depth, kind, &l));
+    ne_207_set_discard(i_session, NULL);
+    ne_set_progress(i_session, NULL, NULL);
+
+    if (l.count > 0)
+	g_op_bytes = (double)l.bytes / l.count;
+    per = l.count > 0 ? (double)(tally.bodies ? tally.responses 
+				 : l.responses) / l.count : 0;
+    my_printf(tmp);
+    if (g_echo)
+	printf("%*s Listing: %.0f responses/op  %.0f [responses/s]\n", 30, "",
+	       per, per * g_ops);
     return OK;
 }
 
+int propfindlist(void)
+{
+    char tmp[64], *coll, *bottom;
+    int n, d, kind;
+
+    if (pget_option.nlistings < 1)
+	return OK;
+
+    for (n = 0; n < pget_option.nlistings; n++) {
+	int width = pget_option.listing[n];
+
+	sprintf(tmp, "list%d/", width);
+	coll = ne_concat(i_path, tmp, NULL);
+	ne_delete(i_session, coll);
+	ONV(ne_mkcol(i_session, coll),
+	    ("MKCOL %s: %s", coll, ne_get_error(i_session)));
+	my_mkcol2_width(coll, pget_option.depth, width);
+
+	/* the members are at the bottom of the tree. */
+	bottom = ne_strdup(coll);
+	for (d = 1; d < pget_option.depth; d++) {
+	    char *sub = ne_concat(bottom, "sub/", NULL);
+	    ne_free(bottom);
+	    bottom = sub;
+	}
+
+	for (kind = LIST_ALLPROP; kind <= LIST_NAMES; kind++)
+	    CALL(time_list(bottom, NE_DEPTH_ONE, kind, width));
+	for (kind = LIST_ALLPROP; kind <= LIST_NAMES; kind++)
+	    CALL(time_list(coll, NE_DEPTH_INFINITE, kind, width));
+
+	ne_delete(i_session, coll);
+	ne_free(bottom);
+	ne_free(coll);
+    }
+
+    return OK;
+}